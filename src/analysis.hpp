@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// A worker thread running jobs of analysis in turn, such as searches
+/// and solves, so that they never block the thread posting them.
+///
+/// All jobs queued are meant for the same position. When the position
+/// changes, `cancel_all` drops the queued jobs and cancels the running
+/// one through the flag it is given, which it should poll, for example
+/// as `SearchLimits::cancel`.
+class AnalysisWorker {
+  public:
+    /// A job, given the flag by which it is cancelled.
+    typedef std::function<void(const std::atomic<bool> &cancelled)> Job;
+
+  private:
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<Job> jobs;
+    std::atomic<bool> cancelled{false};
+    bool quitting = false;
+    std::thread thread;
+
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock lock(mutex);
+                wakeup.wait(lock, [&] { return quitting || !jobs.empty(); });
+                if (quitting)
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                // Any job queued is still wanted, as cancelling clears
+                // the queue under the same lock.
+                cancelled = false;
+            }
+            job(cancelled);
+        }
+    }
+
+  public:
+    AnalysisWorker() : thread([this] { run(); }) {}
+
+    ~AnalysisWorker() { stop(); }
+
+    /// Queues a job, to run after those queued before.
+    void post(Job job) {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+        wakeup.notify_one();
+    }
+
+    /// Drops the queued jobs and cancels the running one (if any).
+    void cancel_all() {
+        std::lock_guard lock(mutex);
+        jobs.clear();
+        cancelled = true;
+    }
+
+    /// Cancels all jobs and waits for the worker to finish.
+    void stop() {
+        {
+            std::lock_guard lock(mutex);
+            jobs.clear();
+            cancelled = true;
+            quitting = true;
+            wakeup.notify_one();
+        }
+        if (thread.joinable())
+            thread.join();
+    }
+};
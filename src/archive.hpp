@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+#include "canonical.hpp"
+#include "database.hpp"
+#include "game.hpp"
+
+/// Number of moves that make up the opening of a game.
+const usize OPENING_MOVES = 3;
+
+/// Number of games aggregated between two checks for cancellation.
+const usize AGGREGATE_CHECK_INTERVAL = 4096;
+
+/// Returns the axis of a row, which must span at least two points.
+Axis row_axis(Row row) {
+    if (row.start.x == row.end.x)
+        return Axis::Vertical;
+    if (row.start.y == row.end.y)
+        return Axis::Horizontal;
+    bool same_sign = (row.start.x < row.end.x) == (row.start.y < row.end.y);
+    return same_sign ? Axis::Descending : Axis::Ascending;
+}
+
+/// Statistics of the games starting with an opening.
+struct OpeningStats {
+    /// The opening in canonical form, of which the first `len` moves
+    /// are used, as shorter games make shorter openings.
+    std::array<Move, OPENING_MOVES> moves;
+    usize len = 0;
+    u64 games = 0;
+    u64 black_wins = 0;
+    u64 white_wins = 0;
+};
+
+/// Statistics of a collection of games.
+struct ArchiveStats {
+    u64 games = 0;
+    /// Games that failed to deserialize, which count nowhere else.
+    u64 invalid = 0;
+    u64 black_wins = 0;
+    u64 white_wins = 0;
+    /// Number of games by the number of moves in the main line.
+    std::array<u64, BOARD_SIZE * BOARD_SIZE + 1> lengths{};
+    /// Number of won games by the axis of the winning row.
+    std::array<u64, 4> win_axes{};
+    /// Statistics by opening, keyed by its canonical hash, so that
+    /// openings that are rotations or reflections of each other count
+    /// as one.
+    std::unordered_map<u64, OpeningStats> openings;
+
+    /// Adds a game, using a canonicaliser of the empty sequence as
+    /// scratch space, which is left as it was.
+    void add(const Game &game, Canonicalizer &canon) {
+        span<const Move> moves = game.past_moves();
+        games++;
+        lengths[moves.size()]++;
+
+        Stone winner = Stone::None;
+        if (auto win = game.first_win()) {
+            winner = moves[win->index - 1].stone;
+            win_axes[usize(row_axis(win->row))]++;
+            (winner == Stone::Black ? black_wins : white_wins)++;
+        }
+
+        usize len = std::min(moves.size(), OPENING_MOVES);
+        for (usize i = 0; i < len; i++)
+            canon.push(moves[i]);
+        OpeningStats &opening = openings[canon.hash()];
+        if (opening.games == 0) {
+            u32 sym = canon.symmetry();
+            for (usize i = 0; i < len; i++)
+                opening.moves[i] = transform(moves[i], sym);
+            opening.len = len;
+        }
+        opening.games++;
+        opening.black_wins += winner == Stone::Black;
+        opening.white_wins += winner == Stone::White;
+        for (usize i = 0; i < len; i++)
+            canon.pop();
+    }
+
+    /// Merges the statistics of other games.
+    ArchiveStats &operator+=(const ArchiveStats &other) {
+        games += other.games;
+        invalid += other.invalid;
+        black_wins += other.black_wins;
+        white_wins += other.white_wins;
+        for (usize i = 0; i < lengths.size(); i++)
+            lengths[i] += other.lengths[i];
+        for (usize i = 0; i < win_axes.size(); i++)
+            win_axes[i] += other.win_axes[i];
+        for (const auto &[key, stats] : other.openings) {
+            OpeningStats &opening = openings[key];
+            if (opening.games == 0) {
+                opening.moves = stats.moves;
+                opening.len = stats.len;
+            }
+            opening.games += stats.games;
+            opening.black_wins += stats.black_wins;
+            opening.white_wins += stats.white_wins;
+        }
+        return *this;
+    }
+
+    /// Returns the average number of moves of a game.
+    double average_length() const {
+        u64 moves = 0;
+        for (usize i = 0; i < lengths.size(); i++)
+            moves += i * lengths[i];
+        return games == 0 ? 0.0 : double(moves) / double(games);
+    }
+
+    /// Returns up to `n` openings played the most, in descending order.
+    vector<const OpeningStats *> top_openings(usize n) const {
+        vector<const OpeningStats *> res;
+        res.reserve(openings.size());
+        for (const auto &entry : openings)
+            res.push_back(&entry.second);
+        n = std::min(n, res.size());
+        std::partial_sort(res.begin(), res.begin() + n, res.end(),
+                          [](const OpeningStats *a, const OpeningStats *b) {
+                              return a->games > b->games;
+                          });
+        res.resize(n);
+        return res;
+    }
+};
+
+/// Aggregates the statistics of the games in a database.
+///
+/// The games are split into contiguous ranges, one for each thread,
+/// and each thread replays its games into a game of its own with the
+/// reusing deserializer, adding them to statistics of its own, which
+/// are merged once all threads are done. If `cancel` is set during the
+/// aggregation, the statistics returned are partial.
+ArchiveStats aggregate_stats(const Database &db, usize threads,
+                             const std::atomic<bool> *cancel = nullptr) {
+    threads = std::clamp<usize>(threads, 1, std::max<usize>(db.size(), 1));
+    vector<ArchiveStats> parts(threads);
+    vector<std::thread> pool;
+    for (usize t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            usize begin = db.size() * t / threads;
+            usize end = db.size() * (t + 1) / threads;
+            ArchiveStats &stats = parts[t];
+            Game game;
+            Canonicalizer canon;
+            for (usize i = begin; i < end; i++) {
+                if ((i - begin) % AGGREGATE_CHECK_INTERVAL == 0 && cancel &&
+                    *cancel)
+                    break;
+                if (db.load(i, game))
+                    stats.add(game, canon);
+                else
+                    stats.invalid++;
+            }
+        });
+    }
+    for (std::thread &thread : pool)
+        thread.join();
+
+    for (usize t = 1; t < threads; t++)
+        parts[0] += parts[t];
+    return std::move(parts[0]);
+}
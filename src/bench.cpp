@@ -0,0 +1,159 @@
+#include <QtCore>
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+
+#include "archive.hpp"
+#include "core.hpp"
+#include "fixtures.hpp"
+#include "game.hpp"
+
+/// Searches for a win row through every stone of the final position.
+void bench_find_win_row(benchmark::State &state, const Game &game) {
+    const Board &board = game.position();
+    for (auto _ : state) {
+        for (Move move : game.past_moves())
+            benchmark::DoNotOptimize(board.find_win_row(move.pos));
+    }
+    state.SetItemsProcessed(state.iterations() * game.move_index());
+}
+
+/// Scans the rows through every stone of the final position along all
+/// axes.
+void bench_scan_row(benchmark::State &state, const Game &game) {
+    const Board &board = game.position();
+    Row row;
+    for (auto _ : state) {
+        for (Move move : game.past_moves()) {
+            for (Axis axis : AXES)
+                benchmark::DoNotOptimize(board.scan_row(move.pos, axis, row));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * game.move_index() * 4);
+}
+
+/// Replays the moves of the game one by one on an empty game.
+void bench_make_move(benchmark::State &state, const Game &game) {
+    for (auto _ : state) {
+        Game replay;
+        for (Move move : game.past_moves())
+            replay.make_move(move.pos, move.stone);
+        benchmark::DoNotOptimize(replay.hash());
+    }
+    state.SetItemsProcessed(state.iterations() * game.move_index());
+}
+
+/// Undoes all moves of the game and then redoes them.
+void bench_undo_redo(benchmark::State &state, const Game &game) {
+    Game copy = game;
+    for (auto _ : state) {
+        while (copy.undo())
+            ;
+        while (copy.redo())
+            ;
+        benchmark::DoNotOptimize(copy.hash());
+    }
+    state.SetItemsProcessed(state.iterations() * game.move_index() * 2);
+}
+
+/// Jumps back and forth across the timeline of the game, between
+/// pseudorandom move indices.
+void bench_jump(benchmark::State &state, const Game &game) {
+    Game copy = game;
+    vector<usize> targets(256);
+    u64 seed = 0;
+    for (usize &target : targets)
+        target = splitmix64(seed) % (game.total_moves() + 1);
+
+    usize i = 0;
+    for (auto _ : state) {
+        copy.jump(targets[i++ % targets.size()]);
+        benchmark::DoNotOptimize(copy.hash());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/// Serializes the game into a reused buffer.
+void bench_serialize(benchmark::State &state, const Game &game) {
+    QByteArray buf;
+    for (auto _ : state) {
+        buf.resize(0);
+        game.serialize_into(buf);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+
+/// Deserializes the game into a reused game.
+void bench_deserialize(benchmark::State &state, const Game &game) {
+    QByteArray buf = game.serialize();
+    span<const u8> bytes(reinterpret_cast<const u8 *>(buf.constData()),
+                         usize(buf.size()));
+    Game out;
+    for (auto _ : state) {
+        if (!Game::deserialize(bytes, out)) {
+            state.SkipWithError("deserialization failed");
+            break;
+        }
+        benchmark::DoNotOptimize(out.hash());
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+
+/// Deserializes the game and adds it to statistics, as each thread of
+/// `aggregate_stats` does for every game in a database.
+void bench_aggregate(benchmark::State &state, const Game &game) {
+    QByteArray buf = game.serialize();
+    span<const u8> bytes(reinterpret_cast<const u8 *>(buf.constData()),
+                         usize(buf.size()));
+    Game out;
+    ArchiveStats stats;
+    Canonicalizer canon;
+    for (auto _ : state) {
+        if (!Game::deserialize(bytes, out)) {
+            state.SkipWithError("deserialization failed");
+            break;
+        }
+        stats.add(out, canon);
+    }
+    benchmark::DoNotOptimize(stats.games);
+    state.SetItemsProcessed(state.iterations());
+}
+
+int main(int argc, char *argv[]) {
+    benchmark::Initialize(&argc, argv);
+
+    // Flags of the benchmark library are consumed above, leaving the
+    // path to the list of games, if given.
+    QString path = argc > 1 ? QString(argv[1]) : QString(GOMOKU_FIXTURES);
+    auto fixtures = load_fixtures(path);
+    if (!fixtures) {
+        std::fprintf(stderr, "gomoku-bench: cannot load games from %s\n",
+                     qPrintable(path));
+        return 1;
+    }
+
+    const std::pair<const char *, void (*)(benchmark::State &, const Game &)>
+        benches[] = {
+            {"find_win_row", bench_find_win_row},
+            {"scan_row", bench_scan_row},
+            {"make_move", bench_make_move},
+            {"undo_redo", bench_undo_redo},
+            {"jump", bench_jump},
+            {"serialize", bench_serialize},
+            {"deserialize", bench_deserialize},
+            {"aggregate", bench_aggregate},
+        };
+    for (auto [bench_name, bench] : benches) {
+        for (const Fixture &fixture : *fixtures) {
+            std::string name = std::string(bench_name) + '/' + fixture.name;
+            benchmark::RegisterBenchmark(name.c_str(), bench, fixture.game);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
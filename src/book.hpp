@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include "core.hpp"
+#include "tt.hpp"
+
+/// The magic bytes at the start of an opening book.
+const char BOOK_MAGIC[8] = {'G', 'O', 'M', 'O', 'K', 'U', 'B', 'K'};
+
+/// The version of the book format.
+const u32 BOOK_VERSION = 1;
+
+/// Size of the book header, in bytes.
+///
+/// The header consists of the magic bytes, the format version (`u32`),
+/// the board size (`u32`) and the number of slots (`u64`), which is a
+/// power of two, in order. All integers in a book are little-endian.
+const usize BOOK_HEADER_SIZE = 24;
+
+/// Size of a slot in the book, in bytes.
+///
+/// The slots follow the header and make up an open-addressing hash
+/// table with linear probing, indexed by the low bits of the canonical
+/// key. Each slot holds the key (`u64`), the score (`i32`) and the move
+/// (`u8`) in the canonical form of the position, or `NO_MOVE` if the
+/// slot is empty, followed by padding.
+const usize BOOK_SLOT_SIZE = 16;
+
+/// A position in the book, namely its best move and score for the
+/// stone to play.
+struct BookEntry {
+    Point move;
+    i32 score;
+};
+
+/// Returns the key of a position with a stone to play in the book,
+/// along with the symmetry that transforms it into its canonical form.
+pair<u64, u32> book_key(const Board &board, Stone stone) {
+    return board.canonical_hash(stone == Stone::White ? WHITE_TO_PLAY_KEY : 0);
+}
+
+/// A read-only opening book, memory-mapped from a file.
+///
+/// Positions are looked up by canonical hash, so that a stored position
+/// also answers for all of its rotations and reflections. The file is
+/// only opened and mapped on the first lookup, and a missing or invalid
+/// file makes an empty book. Lookups are thread-safe.
+class Book {
+    QString path;
+    mutable std::once_flag loaded;
+    mutable std::unique_ptr<QFile> file;
+    mutable const u8 *slots = nullptr;
+    mutable u64 slot_mask = 0;
+
+    void load() const {
+        file = std::make_unique<QFile>(path);
+        if (path.isEmpty() || !file->open(QIODevice::ReadOnly))
+            return;
+
+        u64 size = file->size();
+        if (size < BOOK_HEADER_SIZE + BOOK_SLOT_SIZE)
+            return;
+        const u8 *base = file->map(0, size);
+        if (!base)
+            return;
+
+        u64 count = qFromLittleEndian<u64>(base + 16);
+        if (std::memcmp(base, BOOK_MAGIC, sizeof BOOK_MAGIC) != 0 ||
+            qFromLittleEndian<u32>(base + 8) != BOOK_VERSION ||
+            qFromLittleEndian<u32>(base + 12) != BOARD_SIZE ||
+            !std::has_single_bit(count) ||
+            count != (size - BOOK_HEADER_SIZE) / BOOK_SLOT_SIZE)
+            return;
+
+        slots = base + BOOK_HEADER_SIZE;
+        slot_mask = count - 1;
+    }
+
+  public:
+    /// Creates an empty book.
+    Book() = default;
+
+    /// Creates a book to be loaded from a file.
+    explicit Book(const QString &path) : path(path) {}
+
+    /// Looks up the position with a stone to play.
+    optional<BookEntry> probe(const Board &board, Stone stone) const {
+        std::call_once(loaded, [this] { load(); });
+        if (!slots)
+            return nullopt;
+
+        auto [key, sym] = book_key(board, stone);
+        for (u64 n = 0; n <= slot_mask; n++) {
+            const u8 *slot = slots + ((key + n) & slot_mask) * BOOK_SLOT_SIZE;
+            u8 move = slot[12];
+            if (move == NO_MOVE)
+                return nullopt;
+            if (qFromLittleEndian<u64>(slot) != key ||
+                move >= BOARD_SIZE * BOARD_SIZE)
+                continue;
+
+            // Map the move back out of the canonical form.
+            Point canonical(move % BOARD_SIZE, move / BOARD_SIZE);
+            Point p = transform(canonical, inverse_symmetry(sym));
+            if (board.at(p) != Stone::None)
+                return nullopt;
+            return BookEntry{p, qFromLittleEndian<i32>(slot + 8)};
+        }
+        return nullopt;
+    }
+};
+
+/// A writer of opening books.
+///
+/// Positions are collected in memory and written all at once, with
+/// later additions of a position replacing earlier ones.
+class BookWriter {
+    struct Slot {
+        u64 key;
+        i32 score;
+        u8 move;
+    };
+
+    vector<Slot> entries;
+
+  public:
+    /// Returns the number of positions added.
+    usize size() const { return entries.size(); }
+
+    /// Adds a position with a stone to play and its best move.
+    void add(const Board &board, Stone stone, Point move, i32 score) {
+        auto [key, sym] = book_key(board, stone);
+        Point canonical = transform(move, sym);
+        entries.push_back(
+            {key, score, u8(canonical.y * BOARD_SIZE + canonical.x)});
+    }
+
+    /// Writes the book to a file, returning whether it succeeded.
+    bool write(const QString &path) const {
+        // Keep the table at most half full, so that probes are short.
+        u64 count = std::bit_ceil(std::max<u64>(entries.size() * 2, 1));
+        vector<optional<Slot>> table(count);
+        for (const Slot &entry : entries) {
+            for (u64 i = entry.key;; i++) {
+                auto &slot = table[i & (count - 1)];
+                if (!slot || slot->key == entry.key) {
+                    slot = entry;
+                    break;
+                }
+            }
+        }
+
+        QByteArray buf(BOOK_MAGIC, sizeof BOOK_MAGIC);
+        buf.reserve(BOOK_HEADER_SIZE + count * BOOK_SLOT_SIZE);
+        auto append_le = [&](auto value) {
+            char bytes[sizeof value];
+            qToLittleEndian(value, bytes);
+            buf.append(bytes, sizeof value);
+        };
+        append_le(BOOK_VERSION);
+        append_le(u32(BOARD_SIZE));
+        append_le(count);
+        for (const auto &slot : table) {
+            Slot s = slot.value_or(Slot{0, 0, NO_MOVE});
+            append_le(s.key);
+            append_le(s.score);
+            const char rest[4] = {char(s.move), 0, 0, 0};
+            buf.append(rest, sizeof rest);
+        }
+
+        QSaveFile file(path);
+        return file.open(QIODevice::WriteOnly) &&
+               file.write(buf) == buf.size() && file.commit();
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "game.hpp"
+
+/// Returns the key of a move at an index in a sequence, for hashing
+/// move sequences as the XOR of the keys of their moves.
+constexpr u64 sequence_key(usize index, Move move) {
+    u64 state = (index * 3 + usize(move.stone)) * BOARD_SIZE * BOARD_SIZE +
+                move.pos.y * BOARD_SIZE + move.pos.x;
+    return splitmix64(state);
+}
+
+/// Returns the move transformed by a symmetry.
+constexpr Move transform(Move move, u32 sym) {
+    return {transform(move.pos, sym), move.stone};
+}
+
+/// An incremental canonicaliser of move sequences under the symmetries
+/// of the board.
+///
+/// The canonical form of a sequence is its image under the symmetry
+/// that makes it the least in lexicographic order, comparing moves by
+/// stone and then by `y * BOARD_SIZE + x`. The canonicaliser keeps the
+/// hash of the sequence under every symmetry, along with the set of
+/// symmetries still tied for the least image, so that each move pushed
+/// or popped costs constant time, and games sharing a prefix may share
+/// the work on it by copying the canonicaliser.
+class Canonicalizer {
+    std::array<u64, SYMMETRY_COUNT> hashes{};
+    /// The sets of tied symmetries, as bit masks, after each move.
+    vector<u8> tied{0xff};
+    vector<Move> moves;
+
+    static u32 order(Move move) {
+        return u32(move.stone) << 8 | (move.pos.y * BOARD_SIZE + move.pos.x);
+    }
+
+  public:
+    /// Creates a canonicaliser of an empty sequence.
+    Canonicalizer() = default;
+
+    /// Creates a canonicaliser of a sequence.
+    explicit Canonicalizer(span<const Move> seq) {
+        moves.reserve(seq.size());
+        tied.reserve(seq.size() + 1);
+        for (Move move : seq)
+            push(move);
+    }
+
+    /// Returns the number of moves in the sequence.
+    usize size() const { return moves.size(); }
+
+    /// Appends a move to the sequence.
+    void push(Move move) {
+        usize index = moves.size();
+        u8 old_tied = tied.back(), new_tied = 0;
+        u32 least = UINT32_MAX;
+        for (u32 sym = 0; sym < SYMMETRY_COUNT; sym++) {
+            Move image = transform(move, sym);
+            hashes[sym] ^= sequence_key(index, image);
+            if (!(old_tied >> sym & 1))
+                continue;
+            u32 o = order(image);
+            if (o < least) {
+                least = o;
+                new_tied = 0;
+            }
+            if (o == least)
+                new_tied |= 1 << sym;
+        }
+        tied.push_back(new_tied);
+        moves.push_back(move);
+    }
+
+    /// Removes the last move from the sequence (if any).
+    bool pop() {
+        if (moves.empty())
+            return false;
+        Move move = moves.back();
+        moves.pop_back();
+        tied.pop_back();
+        for (u32 sym = 0; sym < SYMMETRY_COUNT; sym++)
+            hashes[sym] ^= sequence_key(moves.size(), transform(move, sym));
+        return true;
+    }
+
+    /// Returns a symmetry that transforms the sequence into its
+    /// canonical form. All such symmetries give the same image.
+    u32 symmetry() const { return std::countr_zero(tied.back()); }
+
+    /// Returns the hash of the canonical form of the sequence, which is
+    /// the same for all sequences that are images of each other.
+    u64 hash() const { return hashes[symmetry()]; }
+
+    /// Returns the canonical form of the sequence.
+    vector<Move> canonical_moves() const {
+        u32 sym = symmetry();
+        vector<Move> res;
+        res.reserve(moves.size());
+        for (Move move : moves)
+            res.push_back(transform(move, sym));
+        return res;
+    }
+};
+
+/// Returns the game with its past moves in canonical form.
+Game canonical_game(const Game &game) {
+    Game res;
+    for (auto [pos, stone] : Canonicalizer(game.past_moves()).canonical_moves())
+        res.make_move(pos, stone);
+    return res;
+}
@@ -0,0 +1,381 @@
+#include <QtCore>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "book.hpp"
+#include "canonical.hpp"
+#include "core.hpp"
+#include "database.hpp"
+#include "engine.hpp"
+#include "game.hpp"
+#include "stats.hpp"
+#include "trie.hpp"
+#include "uri.hpp"
+
+/// Number of records queued per worker before reading blocks.
+const usize QUEUE_DEPTH_PER_WORKER = 256;
+
+/// Size of the transposition table of each worker engine, in MiB.
+const usize WORKER_HASH_MB = 16;
+
+/// A line of input, along with its 1-based line number.
+struct Record {
+    u64 number;
+    QByteArray text;
+};
+
+/// A bounded queue of records, read by one thread and consumed by
+/// many, so that the input is never loaded into memory as a whole.
+class RecordQueue {
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::deque<Record> records;
+    usize capacity;
+    bool closed = false;
+
+  public:
+    explicit RecordQueue(usize capacity) : capacity(capacity) {}
+
+    /// Pushes a record, blocking while the queue is full.
+    void push(Record record) {
+        std::unique_lock lock(mutex);
+        not_full.wait(lock, [&] { return records.size() < capacity; });
+        records.push_back(std::move(record));
+        not_empty.notify_one();
+    }
+
+    /// Pops a record, blocking while the queue is empty and open.
+    /// Returns `nullopt` once the queue is closed and drained.
+    optional<Record> pop() {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [&] { return !records.empty() || closed; });
+        if (records.empty())
+            return nullopt;
+        Record record = std::move(records.front());
+        records.pop_front();
+        not_full.notify_one();
+        return record;
+    }
+
+    /// Closes the queue, so that consumers stop once it is drained.
+    void close() {
+        std::lock_guard lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+/// Returns the name of a stone in output.
+const char *stone_name(Stone stone) {
+    switch (stone) {
+    case Stone::Black:
+        return "black";
+    case Stone::White:
+        return "white";
+    default:
+        return "none";
+    }
+}
+
+/// Returns the name of a URI error in output.
+const char *error_name(UriError error) {
+    switch (error) {
+    case UriError::MissingPrefix:
+        return "missing_prefix";
+    case UriError::MissingTerminator:
+        return "missing_terminator";
+    case UriError::InvalidBase64:
+        return "invalid_base64";
+    case UriError::InvalidGame:
+        return "invalid_game";
+    }
+    return "unknown";
+}
+
+/// Formats a point as a JSON array.
+std::string point_json(Point p) {
+    return "[" + std::to_string(p.x) + "," + std::to_string(p.y) + "]";
+}
+
+/// Formats the result of a search as JSON object members, each preceded
+/// by a comma, with the statistics if they are counted.
+std::string search_json(const SearchResult &res) {
+    std::string out;
+    if (res.best)
+        out += ",\"best\":" + point_json(*res.best);
+    out += ",\"score\":" + std::to_string(res.score) +
+           ",\"depth\":" + std::to_string(res.depth) +
+           ",\"nodes\":" + std::to_string(res.nodes) +
+           ",\"time_ms\":" + std::to_string(res.elapsed.count());
+
+    out += ",\"pv\":[";
+    for (usize i = 0; i < res.pv.size(); i++)
+        out += (i == 0 ? "" : ",") + point_json(res.pv[i]);
+    out += "],\"depth_times_ms\":[";
+    for (usize i = 0; i < res.depth_times.size(); i++)
+        out += (i == 0 ? "" : ",") + std::to_string(res.depth_times[i].count());
+    out += "]";
+
+    if (STATS_ENABLED) {
+        const SearchStats &stats = res.stats;
+        out += ",\"stats\":{\"leaves\":" +
+               std::to_string(stats[Stat::Leaves]) +
+               ",\"tt_probes\":" + std::to_string(stats[Stat::TtProbes]) +
+               ",\"tt_hits\":" + std::to_string(stats[Stat::TtHits]) +
+               ",\"cutoffs\":" + std::to_string(stats[Stat::Cutoffs]) +
+               ",\"first_move_cutoffs\":" +
+               std::to_string(stats[Stat::FirstMoveCutoffs]) + "}";
+    }
+    return out;
+}
+
+/// Analyses a record into a line of JSON output, decoding it into a
+/// reusable game, and returns whether the record is valid.
+///
+/// If `engine` is not null, it also searches for the best move for the
+/// stone to play at the end of the game, writing the result to `res`.
+bool analyse(const Record &record, UriCodec &codec, Game &game,
+             Engine *engine, const SearchLimits &limits,
+             SearchResult &res, std::string &out) {
+    out = "{\"line\":" + std::to_string(record.number);
+
+    UriError error;
+    if (!codec.decode({record.text.constData(), usize(record.text.size())},
+                      game, &error)) {
+        out += ",\"valid\":false,\"error\":\"";
+        out += error_name(error);
+        out += "\"}\n";
+        return false;
+    }
+
+    out += ",\"valid\":true,\"moves\":" + std::to_string(game.total_moves());
+    if (auto win = game.first_win()) {
+        Stone winner = game.past_moves()[win->index - 1].stone;
+        out += ",\"win\":{\"index\":" + std::to_string(win->index) +
+               ",\"stone\":\"" + stone_name(winner) +
+               "\",\"row\":[" + point_json(win->row.start) + "," +
+               point_json(win->row.end) + "]}";
+    }
+
+    if (engine) {
+        Stone turn = game.infer_turn();
+        res = engine->search(game, turn, limits);
+        out += ",\"analysis\":{\"stone\":\"" + std::string(stone_name(turn)) +
+               "\"" + search_json(res) + "}";
+    }
+    out += "}\n";
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("gomoku-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Validates gomoku game URIs, one per line, writing a line of JSON "
+        "for each as soon as it is done, in order of completion.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "Input file (stdin if omitted).");
+    QCommandLineOption threads_opt(
+        {"j", "threads"}, "Number of worker threads.", "n",
+        QString::number(std::max(1u, std::thread::hardware_concurrency())));
+    QCommandLineOption analyse_opt(
+        {"a", "analyse"},
+        "Search for the best move at the end of each game for <ms> "
+        "milliseconds.",
+        "ms");
+    QCommandLineOption database_opt(
+        {"o", "database"},
+        "Write the valid games to a database <file>, in order of completion.",
+        "file");
+    QCommandLineOption book_opt(
+        {"b", "book"},
+        "Write the analysed best moves to an opening book <file>. "
+        "Requires --analyse.",
+        "file");
+    QCommandLineOption dedup_opt(
+        {"d", "dedup"},
+        "Mark the games that are rotations or reflections of earlier ones "
+        "as duplicates, and leave them out of the database and the book.");
+    QCommandLineOption trie_opt(
+        {"t", "trie"},
+        "Also write a prefix trie of the moves of the games next to the "
+        "database. Requires --database.");
+    QCommandLineOption progress_opt(
+        {"p", "progress"},
+        "Also write a line of JSON for each progress report of the "
+        "analysis, about every <ms> milliseconds. Requires --analyse.",
+        "ms");
+    QCommandLineOption network_opt(
+        {"n", "network"},
+        "Evaluate with the network in <file> instead of the patterns. "
+        "Requires --analyse.",
+        "file");
+    parser.addOptions({threads_opt, analyse_opt, database_opt, book_opt,
+                       dedup_opt, trie_opt, progress_opt, network_opt});
+    parser.process(app);
+
+    QFile input;
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) {
+        input.open(stdin, QIODevice::ReadOnly);
+    } else {
+        input.setFileName(args[0]);
+        if (!input.open(QIODevice::ReadOnly)) {
+            std::fprintf(stderr, "gomoku-cli: cannot open %s\n",
+                         qPrintable(args[0]));
+            return 1;
+        }
+    }
+
+    usize workers = std::max(parser.value(threads_opt).toUInt(), 1u);
+    bool analysing = parser.isSet(analyse_opt);
+    SearchLimits limits;
+    limits.time = milliseconds(parser.value(analyse_opt).toLongLong());
+
+    optional<DatabaseWriter> database;
+    if (parser.isSet(database_opt))
+        database.emplace(parser.value(database_opt));
+
+    optional<MoveTrieBuilder> trie;
+    if (parser.isSet(trie_opt)) {
+        if (!database) {
+            std::fprintf(stderr, "gomoku-cli: --trie requires --database\n");
+            return 1;
+        }
+        trie.emplace();
+    }
+
+    optional<BookWriter> book;
+    if (parser.isSet(book_opt)) {
+        if (!analysing) {
+            std::fprintf(stderr, "gomoku-cli: --book requires --analyse\n");
+            return 1;
+        }
+        book.emplace();
+    }
+
+    optional<milliseconds> progress_interval;
+    if (parser.isSet(progress_opt)) {
+        if (!analysing) {
+            std::fprintf(stderr,
+                         "gomoku-cli: --progress requires --analyse\n");
+            return 1;
+        }
+        progress_interval =
+            milliseconds(parser.value(progress_opt).toLongLong());
+    }
+
+    optional<Network> network;
+    if (parser.isSet(network_opt)) {
+        if (!analysing) {
+            std::fprintf(stderr, "gomoku-cli: --network requires --analyse\n");
+            return 1;
+        }
+        network = Network::open(parser.value(network_opt));
+        if (!network) {
+            std::fprintf(stderr, "gomoku-cli: cannot load network %s\n",
+                         qPrintable(parser.value(network_opt)));
+            return 1;
+        }
+    }
+
+    // Canonical hashes of the games seen, mapped to their line numbers.
+    bool dedup = parser.isSet(dedup_opt);
+    std::unordered_map<u64, u64> seen;
+
+    RecordQueue queue(workers * QUEUE_DEPTH_PER_WORKER);
+    std::mutex output_mutex;
+
+    auto work = [&] {
+        optional<Engine> engine;
+        u64 number = 0;
+        if (analysing) {
+            engine.emplace(1, WORKER_HASH_MB);
+            engine->set_network(network ? &*network : nullptr);
+        }
+        if (engine && progress_interval) {
+            engine->set_progress_handler(
+                [&](const SearchResult &res) {
+                    std::string line = "{\"line\":" + std::to_string(number) +
+                                       ",\"progress\":{" +
+                                       search_json(res).substr(1) + "}}\n";
+                    std::lock_guard lock(output_mutex);
+                    std::fputs(line.c_str(), stdout);
+                },
+                *progress_interval);
+        }
+        UriCodec codec;
+        Game game;
+        SearchResult res;
+        std::string out;
+        while (auto record = queue.pop()) {
+            if (record->text.trimmed().isEmpty())
+                continue;
+            res = SearchResult();
+            number = record->number;
+            bool valid = analyse(*record, codec, game,
+                                 engine ? &*engine : nullptr, limits, res, out);
+            u64 key = valid && dedup
+                          ? Canonicalizer(game.past_moves()).hash()
+                          : 0;
+
+            std::lock_guard lock(output_mutex);
+            if (valid && dedup) {
+                auto [it, inserted] = seen.try_emplace(key, record->number);
+                if (!inserted) {
+                    // Insert the field before the closing brace.
+                    out.insert(out.size() - 2, ",\"duplicate_of\":" +
+                                                   std::to_string(it->second));
+                    valid = false;
+                }
+            }
+            std::fputs(out.c_str(), stdout);
+            if (database && valid)
+                database->add(game);
+            if (trie && valid)
+                trie->add(game.past_moves());
+            if (book && valid && res.best)
+                book->add(game.position(), game.infer_turn(), *res.best,
+                          res.score);
+        }
+    };
+
+    vector<std::thread> pool;
+    for (usize i = 0; i < workers; i++)
+        pool.emplace_back(work);
+
+    u64 number = 0;
+    while (!input.atEnd())
+        queue.push({++number, input.readLine()});
+    queue.close();
+
+    for (std::thread &thread : pool)
+        thread.join();
+    std::fflush(stdout);
+
+    if (book && !book->write(parser.value(book_opt))) {
+        std::fprintf(stderr, "gomoku-cli: cannot write %s\n",
+                     qPrintable(parser.value(book_opt)));
+        return 1;
+    }
+    QString trie_path = parser.value(database_opt) + TRIE_SUFFIX;
+    if (trie && !trie->write(trie_path)) {
+        std::fprintf(stderr, "gomoku-cli: cannot write %s\n",
+                     qPrintable(trie_path));
+        return 1;
+    }
+    if (database && !database->commit()) {
+        std::fprintf(stderr, "gomoku-cli: cannot write %s\n",
+                     qPrintable(parser.value(database_opt)));
+        return 1;
+    }
+    return 0;
+}
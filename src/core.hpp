@@ -1,18 +1,24 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdint>
 #include <optional>
 #include <span>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
-#include <QByteArray>
-
+typedef std::int8_t i8;
 typedef std::uint8_t u8;
+typedef std::int16_t i16;
+typedef std::uint16_t u16;
 typedef std::int32_t i32;
 typedef std::uint32_t u32;
+typedef std::int64_t i64;
+typedef std::uint64_t u64;
 typedef std::size_t usize;
 
 using std::nullopt;
@@ -61,8 +67,8 @@ struct Point {
     u32 x;
     u32 y;
 
-    Point() : x(0), y(0) {}
-    Point(u32 x, u32 y) : x(x), y(y) {}
+    constexpr Point() : x(0), y(0) {}
+    constexpr Point(u32 x, u32 y) : x(x), y(y) {}
 
     bool operator==(Point other) const { return x == other.x && y == other.y; }
 
@@ -79,259 +85,418 @@ struct Row {
     Point end;
 };
 
+/// A rule variant of gomoku.
+enum struct Rule : u8 {
+    /// A row of five or more stones wins.
+    Freestyle,
+    /// A row of exactly five stones wins.
+    Standard,
+    /// Black wins with exactly five and must not make a double three,
+    /// a double four or an overline, while white wins with five or more.
+    Renju,
+};
+
+/// Checks if the rule requires a win row of the stone to be exactly
+/// five stones long.
+constexpr bool exact_five(Rule rule, Stone stone) {
+    return rule == Rule::Standard ||
+           (rule == Rule::Renju && stone == Stone::Black);
+}
+
+/// Size of the standard board, for which the engine, the solver, the
+/// opening book and the move trie are built.
 const usize BOARD_SIZE = 15;
 
-/// Checks if a point is within the board boundary.
-bool in_board(Point p) { return p.x < BOARD_SIZE && p.y < BOARD_SIZE; }
+/// The geometry of an `N` x `N` board.
+template <usize N> struct Geometry {
+    // Each line is stored as a bit mask, so it must fit in one.
+    static_assert(N >= 5 && N <= 32);
 
-/// A 15x15 gomoku board.
-class Board {
-    vector<Stone> mat{BOARD_SIZE * BOARD_SIZE};
+    /// The bit mask of a line, namely the narrowest type that fits.
+    typedef std::conditional_t<(N <= 16), u16, u32> Line;
 
-  public:
-    /// Returns a reference to the stone at a point.
-    Stone &at(Point p) {
-        if (!in_board(p))
-            throw std::out_of_range("point out of board");
-        return mat.at(p.y * BOARD_SIZE + p.x);
-    }
+    /// Number of bits in the bit mask of a line.
+    static constexpr u32 LINE_BITS = sizeof(Line) * 8;
 
-    /// Returns a const reference to the stone at a point.
-    const Stone &at(Point p) const {
-        if (!in_board(p))
-            throw std::out_of_range("point out of board");
-        return mat.at(p.y * BOARD_SIZE + p.x);
-    }
+    /// Number of points on the board.
+    static constexpr usize CELLS = N * N;
 
-    /// Sets the stone at a point.
-    void set(Point p, Stone stone) { at(p) = stone; }
+    /// Number of lines on the board along each axis, in the order of
+    /// `AXES`.
+    static constexpr std::array<usize, 4> AXIS_LINES = {N, 2 * N - 1, N,
+                                                        2 * N - 1};
 
-    /// Unsets the stone at a point.
-    void unset(Point p) { at(p) = Stone::None; }
+    /// Index of the first line along each axis, in the order of `AXES`.
+    static constexpr std::array<usize, 4> AXIS_LINE_OFFSETS = {
+        0, N, 3 * N - 1, 4 * N - 1};
 
-    /// Scans the row through a point in the direction of the axis.
-    u32 scan_row(Point p, Axis axis, Row &row) const {
-        Stone stone = at(p);
-        u32 len = 1;
-
-        auto scan = [&](Point &cur, bool forward) {
-            Point next;
-            while (in_board(next = cur.adjacent(axis, forward)) &&
-                   at(next) == stone) {
-                len += 1;
-                cur = next;
-            }
-        };
+    /// Total number of lines on the board along all axes.
+    static constexpr usize LINE_COUNT = 6 * N - 2;
+};
+
+/// Index of the first line along each axis on the standard board.
+constexpr auto AXIS_LINE_OFFSETS = Geometry<BOARD_SIZE>::AXIS_LINE_OFFSETS;
+
+/// Total number of lines on the standard board along all axes.
+const usize LINE_COUNT = Geometry<BOARD_SIZE>::LINE_COUNT;
+
+/// Checks if a point is within the boundary of an `N` x `N` board.
+template <usize N = BOARD_SIZE> constexpr bool in_board(Point p) {
+    return p.x < N && p.y < N;
+}
+
+/// A point located on a line, namely a (line index, bit index) pair.
+///
+/// Bit `i` of a line stands for the point on it whose y coordinate
+/// (for vertical lines) or x coordinate (for other lines) is `i`,
+/// so that moving forward along the axis moves to a higher bit.
+struct LinePos {
+    usize line;
+    u32 bit;
+};
 
-        row = {p, p};
-        scan(row.start, false);
-        scan(row.end, true);
-        return len;
+/// Locates the line through a point in the direction of the axis.
+template <usize N = BOARD_SIZE>
+constexpr LinePos line_pos(Point p, Axis axis) {
+    usize offset = Geometry<N>::AXIS_LINE_OFFSETS[usize(axis)];
+    switch (axis) {
+    case Axis::Vertical:
+        return {offset + p.x, p.y};
+    case Axis::Ascending:
+        return {offset + p.x + p.y, p.x};
+    case Axis::Horizontal:
+        return {offset + p.y, p.x};
+    case Axis::Descending:
+        return {offset + p.x + (N - 1) - p.y, p.x};
     }
+    return {0, 0};
+}
 
-    /// Searches for a win row through the point.
-    optional<Row> find_win_row(Point p) const {
-        Stone stone = at(p);
-        if (stone == Stone::None)
-            return nullopt;
+/// Returns the point at a position on a line along the axis.
+///
+/// This is the inverse of `line_pos`.
+template <usize N = BOARD_SIZE>
+constexpr Point line_point(Axis axis, LinePos lp) {
+    u32 i = lp.line - Geometry<N>::AXIS_LINE_OFFSETS[usize(axis)];
+    switch (axis) {
+    case Axis::Vertical:
+        return {i, lp.bit};
+    case Axis::Ascending:
+        return {lp.bit, i - lp.bit};
+    case Axis::Horizontal:
+        return {lp.bit, i};
+    case Axis::Descending:
+        return {lp.bit, lp.bit + u32(N - 1) - i};
+    }
+    return {0, 0};
+}
 
-        Row row;
-        for (Axis axis : AXES) {
-            if (scan_row(p, axis, row) >= 5)
-                return row;
+/// Returns the bit masks of the points within the board boundary on
+/// each line.
+template <usize N> constexpr auto line_masks() {
+    typedef typename Geometry<N>::Line Line;
+    std::array<Line, Geometry<N>::LINE_COUNT> masks{};
+    for (Axis axis : AXES) {
+        for (u32 y = 0; y < N; y++) {
+            for (u32 x = 0; x < N; x++) {
+                LinePos lp = line_pos<N>(Point(x, y), axis);
+                masks[lp.line] |= Line(1) << lp.bit;
+            }
         }
-        return nullopt;
     }
-};
+    return masks;
+}
 
-/// A move on the board, namely a (position, stone) pair.
-struct Move {
-    Point pos;
-    Stone stone;
+/// Bit masks of the points within the standard board boundary on each
+/// line.
+constexpr auto LINE_MASKS = line_masks<BOARD_SIZE>();
 
-    bool operator==(Move other) const {
-        return pos == other.pos && stone == other.stone;
+/// A bitset of the points on an `N` x `N` board, one bit mask per row,
+/// with bit `x` of row `y` standing for the point `(x, y)`.
+template <usize N>
+using BasicBoardMask = std::array<typename Geometry<N>::Line, N>;
+
+/// A bitset of the points on the standard board.
+typedef BasicBoardMask<BOARD_SIZE> BoardMask;
+
+/// Calls a function on each point in a bitset, in row-major order.
+template <class Row, usize N, class F>
+void for_each_point(const std::array<Row, N> &mask, F &&f) {
+    for (u32 y = 0; y < N; y++) {
+        for (Row row = mask[y]; row != 0; row &= row - 1)
+            f(Point(std::countr_zero(row), y));
     }
-};
+}
 
-/// A win witnessed on the board, namely a (move index, row) pair.
-struct Win {
-    usize index;
-    Row row;
-};
+/// Distance within which an unoccupied point counts as a candidate.
+const u32 CANDIDATE_DISTANCE = 2;
+
+/// Returns the next output of a SplitMix64 generator.
+constexpr u64 splitmix64(u64 &state) {
+    u64 z = state += 0x9e3779b97f4a7c15;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
 
-/// A gomoku game, namely a record of moves.
-class Game {
-    Board board;
-    vector<Move> moves;
-    usize index = 0;
-    optional<Win> win;
+/// Returns the Zobrist keys of the stones at the points on an `N` x `N`
+/// board, indexed by stone and then by `y * N + x`. Keys for `None` are
+/// zero.
+template <usize N> constexpr auto zobrist_keys() {
+    std::array<std::array<u64, N * N>, 3> keys{};
+    u64 state = 0;
+    for (usize stone = 1; stone < 3; stone++) {
+        for (u64 &key : keys[stone])
+            key = splitmix64(state);
+    }
+    return keys;
+}
 
-    /// Control bytes used in serialization.
-    enum CtrlByte : u8 { BEGIN_SEQUENCE = 0xff, END_SEQUENCE = 0xfe };
+/// Number of symmetries of the board, namely its rotations and
+/// reflections.
+const u32 SYMMETRY_COUNT = 8;
+
+/// Transforms a point by a symmetry, which for bit 2 swaps the
+/// coordinates, and then for bits 0 and 1 flips `x` and `y` in turn.
+template <usize N = BOARD_SIZE> constexpr Point transform(Point p, u32 sym) {
+    if (sym & 4)
+        std::swap(p.x, p.y);
+    if (sym & 1)
+        p.x = N - 1 - p.x;
+    if (sym & 2)
+        p.y = N - 1 - p.y;
+    return p;
+}
 
-    // Ensure that position bytes cannot collide with control bytes
-    // in serialization.
-    static_assert(BOARD_SIZE * BOARD_SIZE < 0xfe);
+/// Returns the inverse of a symmetry.
+constexpr u32 inverse_symmetry(u32 sym) {
+    // Flipping before swapping is swapping before the other flip.
+    if (sym & 4)
+        return 4 | (sym & 1) << 1 | (sym >> 1 & 1);
+    return sym;
+}
 
-  public:
-    bool operator==(const Game &other) const {
-        return moves == other.moves && index == other.index;
+/// Returns the indices of the points transformed by each symmetry on an
+/// `N` x `N` board, indexed by symmetry and then by `y * N + x`, in the
+/// same form.
+template <usize N> constexpr auto symmetry_indices() {
+    std::array<std::array<u16, N * N>, SYMMETRY_COUNT> indices{};
+    for (u32 sym = 0; sym < SYMMETRY_COUNT; sym++) {
+        for (u32 y = 0; y < N; y++) {
+            for (u32 x = 0; x < N; x++) {
+                Point q = transform<N>({x, y}, sym);
+                indices[sym][y * N + x] = q.y * N + q.x;
+            }
+        }
     }
+    return indices;
+}
 
-    /// Returns the total number of moves, on or off the board,
-    /// in the past or in the future.
-    usize total_moves() const { return moves.size(); }
+/// An `N` x `N` gomoku board.
+///
+/// The board is stored as bit masks of the lines along all axes,
+/// one set for each stone, so that a row in any direction can be
+/// read out with a few bit operations. The horizontal lines alone
+/// make up a plain bitset of the board. As the size is known at compile
+/// time, all indexing is constant-folded and each line takes the
+/// narrowest bit mask that fits.
+///
+/// The candidate points, namely the unoccupied points within
+/// `CANDIDATE_DISTANCE` of any stone, are not stored but dilated from
+/// the occupied points on demand, with a few shifts per row, so that
+/// setting a stone only touches its lines and the hashes.
+///
+/// Only the Zobrist hash of the board itself is kept up to date. The
+/// hashes of its images under the symmetries, which only the opening
+/// book needs, are computed from the stones on demand.
+///
+/// The board thus holds nothing but the lines and one key, 384 bytes for
+/// the standard size, so that copying a snapshot stays cheap. Anything
+/// derived from the stones belongs outside it.
+template <usize N> class alignas(64) BasicBoard {
+    typedef Geometry<N> G;
+    typedef typename G::Line Line;
+
+    static constexpr auto ZOBRIST_KEYS = zobrist_keys<N>();
+    static constexpr auto SYMMETRY_INDICES = symmetry_indices<N>();
+
+    std::array<Line, G::LINE_COUNT> lines[2]{};
+    u64 key = 0;
+
+    /// Mask of the points within the board boundary on a row.
+    static constexpr Line ROW_MASK = Line((u64(1) << N) - 1);
+
+    /// Returns the bit mask of points occupied by any stone on a row.
+    Line occupied_row(u32 y) const {
+        usize line = G::AXIS_LINE_OFFSETS[usize(Axis::Horizontal)] + y;
+        return lines[0][line] | lines[1][line];
+    }
 
-    /// Returns the current move index.
-    usize move_index() const { return index; }
+  public:
+    /// The size of the board.
+    static constexpr usize SIZE = N;
 
-    /// Returns a span of moves in the past.
-    span<const Move> past_moves() const { return {moves.data(), index}; }
+    /// Bit masks of the points within the board boundary on each line.
+    static constexpr auto LINE_MASKS = ::line_masks<N>();
 
-    /// Returns a span of moves in the future.
-    span<const Move> future_moves() const {
-        return {moves.data() + index, moves.size() - index};
+    /// Returns the stone at a point.
+    Stone at(Point p) const {
+        if (!in_board<N>(p))
+            throw std::out_of_range("point out of board");
+        usize line = G::AXIS_LINE_OFFSETS[usize(Axis::Horizontal)] + p.y;
+        u32 black = (lines[0][line] >> p.x) & 1;
+        u32 white = (lines[1][line] >> p.x) & 1;
+        return Stone(black | white << 1);
     }
 
-    /// Returns the first win witnessed in the past (if any).
-    optional<Win> first_win() const {
-        if (win && win->index <= index)
-            return win;
-        else
-            return nullopt;
+    /// Returns the bit mask of a line for a stone other than `None`.
+    Line line(Stone stone, usize index) const {
+        return lines[usize(stone) - 1][index];
     }
 
-    /// Gets the stone at a point.
-    Stone stone_at(Point p) const { return board.at(p); }
-
-    /// Makes a move at a point, clearing moves in the future.
-    bool make_move(Point p, Stone stone) {
-        Stone &val = board.at(p);
-        if (val != Stone::None)
-            return false;
-        val = stone;
-
-        moves.resize(index);
-        moves.push_back({p, stone});
-        index += 1;
-
-        if (!win || win->index >= index) {
-            if (auto win_row = board.find_win_row(p))
-                win = {index, *win_row};
-            else
-                win = nullopt;
-        }
-        return true;
+    /// Returns the bit masks of all lines for a stone other than `None`,
+    /// indexed as in `line`.
+    const std::array<Line, G::LINE_COUNT> &line_masks(Stone stone) const {
+        return lines[usize(stone) - 1];
     }
 
-    /// Undoes the last move (if any).
-    bool undo() {
-        if (index == 0)
-            return false;
-        index -= 1;
-        Move last = moves.at(index);
-        board.unset(last.pos);
-        return true;
+    /// Returns the Zobrist hash of the stones on the board.
+    u64 hash() const { return key; }
+
+    /// Returns the Zobrist hashes of the board transformed by each
+    /// symmetry, computed from the stones.
+    std::array<u64, SYMMETRY_COUNT> symmetric_hashes() const {
+        std::array<u64, SYMMETRY_COUNT> keys{};
+        usize offset = G::AXIS_LINE_OFFSETS[usize(Axis::Horizontal)];
+        for (Stone stone : {Stone::Black, Stone::White}) {
+            const auto &zobrist = ZOBRIST_KEYS[usize(stone)];
+            for (u32 y = 0; y < N; y++) {
+                for (Line row = line(stone, offset + y); row != 0;
+                     row &= row - 1) {
+                    usize i = y * N + std::countr_zero(row);
+                    for (u32 sym = 0; sym < SYMMETRY_COUNT; sym++)
+                        keys[sym] ^= zobrist[SYMMETRY_INDICES[sym][i]];
+                }
+            }
+        }
+        return keys;
     }
 
-    /// Redoes the next move (if any).
-    bool redo() {
-        if (index >= moves.size())
-            return false;
-        Move next = moves.at(index);
-        index += 1;
-        board.set(next.pos, next.stone);
-        return true;
+    /// Returns the canonical hash of the board, namely the minimum of
+    /// the hashes over all symmetries, each XORed with `salt`, along with
+    /// a symmetry that transforms the board into its canonical form.
+    pair<u64, u32> canonical_hash(u64 salt = 0) const {
+        auto keys = symmetric_hashes();
+        pair<u64, u32> min = {keys[0] ^ salt, 0};
+        for (u32 sym = 1; sym < SYMMETRY_COUNT; sym++)
+            min = std::min(min, {keys[sym] ^ salt, sym});
+        return min;
     }
 
-    /// Jumps to the given move index by undoing or redoing moves.
-    bool jump(usize to_index) {
-        if (to_index > moves.size())
-            throw std::out_of_range("move index out of range");
-        if (index == to_index)
-            return false;
-        if (index > to_index) {
-            for (usize i = index; i > to_index; i--) {
-                Move last = moves.at(i - 1);
-                board.unset(last.pos);
-            }
-        } else {
-            for (usize i = index; i < to_index; i++) {
-                Move next = moves.at(i);
-                board.set(next.pos, next.stone);
+    /// Returns the bitset of candidate points.
+    ///
+    /// The occupied points are dilated along each row and then across
+    /// the rows, which is a square of side `2 * CANDIDATE_DISTANCE + 1`.
+    BasicBoardMask<N> candidates() const {
+        const u32 d = CANDIDATE_DISTANCE;
+        BasicBoardMask<N> occ, wide, cand;
+        for (u32 y = 0; y < N; y++) {
+            Line o = occupied_row(y), w = o;
+            for (u32 i = 1; i <= d; i++)
+                w |= Line(o << i) | Line(o >> i);
+            occ[y] = o;
+            wide[y] = w;
+        }
+        for (u32 y = 0; y < N; y++) {
+            Line c = wide[y];
+            for (u32 i = 1; i <= d; i++) {
+                if (y >= i)
+                    c |= wide[y - i];
+                if (y + i < N)
+                    c |= wide[y + i];
             }
+            cand[y] = c & ~occ[y] & ROW_MASK;
         }
-        index = to_index;
-        return true;
+        return cand;
     }
 
-    /// Infers the next stone to play, based on past moves.
-    Stone infer_turn() const {
-        return index == 0 ? Stone::Black : opposite(moves.at(index - 1).stone);
+    /// Sets the stone at a point.
+    void set(Point p, Stone stone) {
+        usize i = p.y * N + p.x;
+        key ^= ZOBRIST_KEYS[usize(at(p))][i] ^ ZOBRIST_KEYS[usize(stone)][i];
+        for (Axis axis : AXES) {
+            auto [line, bit] = line_pos<N>(p, axis);
+            Line mask = Line(1) << bit;
+            lines[0][line] &= ~mask;
+            lines[1][line] &= ~mask;
+            if (stone != Stone::None)
+                lines[usize(stone) - 1][line] |= mask;
+        }
     }
 
-    /// Serializes the game into a byte array.
-    QByteArray serialize() const {
-        QByteArray buf;
+    /// Unsets the stone at a point.
+    void unset(Point p) { set(p, Stone::None); }
 
-        auto moves = past_moves();
-        if (!moves.empty() && moves[0].stone == Stone::White) {
-            buf.append(CtrlByte::BEGIN_SEQUENCE);
-            buf.append(CtrlByte::END_SEQUENCE);
-        }
+    /// Returns the bit mask of a line for any stone, including `None`.
+    Line line_of(Stone stone, usize index) const {
+        if (stone == Stone::None)
+            return LINE_MASKS[index] & ~(lines[0][index] | lines[1][index]);
+        return line(stone, index);
+    }
 
-        Stone last_stone = Stone::None;
-        bool in_sequence = false;
-        for (auto [pos, stone] : moves) {
-            if (last_stone == stone) {
-                if (!in_sequence) {
-                    buf.insert(buf.size() - 1, CtrlByte::BEGIN_SEQUENCE);
-                    in_sequence = true;
-                }
-            } else if (in_sequence) {
-                buf.append(CtrlByte::END_SEQUENCE);
-                in_sequence = false;
-            }
-            buf.append(pos.y * BOARD_SIZE + pos.x);
-            last_stone = stone;
-        }
+    /// Scans the row through a point in the direction of the axis.
+    ///
+    /// The row is read out of the line bit mask in constant time,
+    /// by counting the run of set bits on each side of the point.
+    u32 scan_row(Point p, Axis axis, Row &row) const {
+        Stone stone = at(p);
+        auto [line, bit] = line_pos<N>(p, axis);
+        Line mask = line_of(stone, line);
+
+        // Both counts include the point itself.
+        u32 forward = std::countr_one(Line(mask >> bit));
+        u32 backward =
+            std::countl_one(Line(mask << (G::LINE_BITS - 1 - bit)));
 
-        if (in_sequence)
-            buf.append(CtrlByte::END_SEQUENCE);
-        return buf;
+        row = {line_point<N>(axis, {line, bit - (backward - 1)}),
+               line_point<N>(axis, {line, bit + (forward - 1)})};
+        return forward + backward - 1;
     }
 
-    /// Deserializes the byte array into a game.
-    static optional<Game> deserialize(const QByteArray &buf) {
-        Game game;
-        Stone stone = Stone::Black;
-        bool in_sequence = false;
-
-        for (u8 byte : buf) {
-            if (byte == CtrlByte::BEGIN_SEQUENCE) {
-                if (in_sequence)
-                    return nullopt;
-                in_sequence = true;
-                continue;
-            }
-            if (byte == CtrlByte::END_SEQUENCE) {
-                if (!in_sequence)
-                    return nullopt;
-                in_sequence = false;
-                stone = opposite(stone);
-                continue;
-            }
+    /// Searches for a win row through the point under the rule.
+    optional<Row> find_win_row(Point p, Rule rule = Rule::Freestyle) const {
+        Stone stone = at(p);
+        if (stone == Stone::None)
+            return nullopt;
 
-            Point pos(byte % BOARD_SIZE, byte / BOARD_SIZE);
-            if (!in_board(pos) || !game.make_move(pos, stone))
-                return nullopt;
-            if (!in_sequence)
-                stone = opposite(stone);
+        bool exact = exact_five(rule, stone);
+        Row row;
+        for (Axis axis : AXES) {
+            u32 len = scan_row(p, axis, row);
+            if (exact ? len == 5 : len >= 5)
+                return row;
         }
+        return nullopt;
+    }
+};
 
-        if (in_sequence)
-            return nullopt;
-        return game;
+/// The standard 15x15 gomoku board.
+typedef BasicBoard<BOARD_SIZE> Board;
+
+static_assert(sizeof(Board) == 384, "the board holds only lines and a key");
+
+/// A move on the board, namely a (position, stone) pair.
+struct Move {
+    Point pos;
+    Stone stone;
+
+    bool operator==(Move other) const {
+        return pos == other.pos && stone == other.stone;
     }
 };
+
+/// A win witnessed on the board, namely a (move index, row) pair.
+struct Win {
+    usize index;
+    Row row;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+
+#include <QFile>
+#include <QSaveFile>
+#include <QTemporaryFile>
+#include <QtEndian>
+
+#include "game.hpp"
+
+/// The magic bytes at the start of a game database.
+const char DATABASE_MAGIC[8] = {'G', 'O', 'M', 'O', 'K', 'U', 'D', 'B'};
+
+/// The version of the database format.
+const u32 DATABASE_VERSION = 1;
+
+/// Size of the database header, in bytes.
+///
+/// The header consists of the magic bytes, the format version (`u32`),
+/// the board size (`u32`) and the number of games (`u64`), in order.
+/// All integers in a database are little-endian.
+const usize DATABASE_HEADER_SIZE = 24;
+
+/// Size of an entry in the offset index, in bytes.
+///
+/// The index follows the header and holds one more offset than there
+/// are games, each relative to the start of the game data, so that
+/// game `i` lies between offsets `i` and `i + 1`. The game data follows
+/// the index, with games serialized by `Game::serialize` back to back.
+const usize DATABASE_OFFSET_SIZE = 8;
+
+/// A read-only game database, memory-mapped from a file.
+///
+/// Opening a database only checks the header and the index, so that
+/// random access to any game takes constant time, and games are handed
+/// out as views into the mapping without copying.
+class Database {
+    std::unique_ptr<QFile> file;
+    const u8 *index = nullptr;
+    const u8 *data = nullptr;
+    usize count = 0;
+
+    u64 offset(usize i) const {
+        return qFromLittleEndian<u64>(index + i * DATABASE_OFFSET_SIZE);
+    }
+
+  public:
+    /// Opens and maps a database file, returning `nullopt` if the file
+    /// cannot be mapped or is not a valid database.
+    static optional<Database> open(const QString &path) {
+        Database db;
+        db.file = std::make_unique<QFile>(path);
+        if (!db.file->open(QIODevice::ReadOnly))
+            return nullopt;
+
+        u64 size = db.file->size();
+        if (size < DATABASE_HEADER_SIZE + DATABASE_OFFSET_SIZE)
+            return nullopt;
+        const u8 *base = db.file->map(0, size);
+        if (!base)
+            return nullopt;
+
+        if (std::memcmp(base, DATABASE_MAGIC, sizeof DATABASE_MAGIC) != 0 ||
+            qFromLittleEndian<u32>(base + 8) != DATABASE_VERSION ||
+            qFromLittleEndian<u32>(base + 12) != BOARD_SIZE)
+            return nullopt;
+
+        u64 count = qFromLittleEndian<u64>(base + 16);
+        u64 rest = size - DATABASE_HEADER_SIZE;
+        if (count >= rest / DATABASE_OFFSET_SIZE)
+            return nullopt;
+
+        db.count = count;
+        db.index = base + DATABASE_HEADER_SIZE;
+        db.data = db.index + (count + 1) * DATABASE_OFFSET_SIZE;
+
+        // Check that the offsets are ordered and within the data, so
+        // that `game` needs no checks of its own.
+        u64 data_size = rest - (count + 1) * DATABASE_OFFSET_SIZE;
+        if (db.offset(0) != 0 || db.offset(count) != data_size)
+            return nullopt;
+        for (usize i = 0; i < count; i++) {
+            if (db.offset(i) > db.offset(i + 1))
+                return nullopt;
+        }
+        return db;
+    }
+
+    /// Returns the number of games.
+    usize size() const { return count; }
+
+    /// Returns a view of the serialized game at an index, which is valid
+    /// as long as the database is.
+    span<const u8> game(usize i) const {
+        if (i >= count)
+            throw std::out_of_range("game index out of range");
+        u64 start = offset(i);
+        return {data + start, usize(offset(i + 1) - start)};
+    }
+
+    /// Deserializes the game at an index.
+    optional<Game> load(usize i) const {
+        Game out;
+        if (!load(i, out))
+            return nullopt;
+        return out;
+    }
+
+    /// Deserializes the game at an index into a reusable game, returning
+    /// whether it is valid.
+    bool load(usize i, Game &out) const {
+        return Game::deserialize(game(i), out);
+    }
+};
+
+/// A writer of game databases.
+///
+/// Games are streamed into a temporary file as they are added, so that
+/// only their offsets are kept in memory. On `commit`, the header and
+/// the index are written to the database file, followed by the games,
+/// and the file replaces any existing one at once.
+class DatabaseWriter {
+    QSaveFile file;
+    QTemporaryFile data;
+    vector<u64> offsets{0};
+    QByteArray buf;
+    bool ok;
+
+  public:
+    /// Creates a writer of a database file at the path.
+    explicit DatabaseWriter(const QString &path) : file(path) {
+        ok = file.open(QIODevice::WriteOnly) && data.open();
+    }
+
+    /// Returns the number of games added.
+    usize size() const { return offsets.size() - 1; }
+
+    /// Adds a serialized game, returning whether it was written.
+    bool add(span<const u8> game) {
+        ok = ok && data.write(reinterpret_cast<const char *>(game.data()),
+                              game.size()) == qint64(game.size());
+        if (ok)
+            offsets.push_back(offsets.back() + game.size());
+        return ok;
+    }
+
+    /// Adds a game, returning whether it was written.
+    bool add(const Game &game) {
+        buf.resize(0);
+        game.serialize_into(buf);
+        return add({reinterpret_cast<const u8 *>(buf.constData()),
+                    usize(buf.size())});
+    }
+
+    /// Writes the database file, returning whether it succeeded.
+    ///
+    /// Nothing is written if any game failed to be written.
+    bool commit() {
+        if (!ok)
+            return false;
+
+        QByteArray head(DATABASE_MAGIC, sizeof DATABASE_MAGIC);
+        auto append_le = [&](auto value) {
+            char bytes[sizeof value];
+            qToLittleEndian(value, bytes);
+            head.append(bytes, sizeof value);
+        };
+        append_le(DATABASE_VERSION);
+        append_le(u32(BOARD_SIZE));
+        append_le(u64(size()));
+        for (u64 offset : offsets)
+            append_le(offset);
+        if (file.write(head) != head.size())
+            return false;
+
+        const qint64 CHUNK_SIZE = 1 << 20;
+        if (!data.seek(0))
+            return false;
+        while (!data.atEnd()) {
+            QByteArray chunk = data.read(CHUNK_SIZE);
+            if (chunk.isEmpty() || file.write(chunk) != chunk.size())
+                return false;
+        }
+        return file.commit();
+    }
+};
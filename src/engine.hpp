@@ -0,0 +1,629 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "book.hpp"
+#include "core.hpp"
+#include "eval.hpp"
+#include "game.hpp"
+#include "nnue.hpp"
+#include "rules.hpp"
+#include "stats.hpp"
+#include "tt.hpp"
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+/// Maximum depth of a search, in plies.
+const u32 MAX_PLY = 64;
+
+/// Maximum number of moves searched at a node, after ordering.
+const usize MAX_BRANCHING = 20;
+
+/// Number of nodes searched between two checks of the limits.
+const u64 CHECK_INTERVAL = 1024;
+
+/// Default interval between two periodic progress reports of a search.
+const milliseconds PROGRESS_INTERVAL(100);
+
+/// Checks if a score means a forced win or loss.
+bool is_win_score(i32 score) {
+    return std::abs(score) >= WIN_SCORE - i32(MAX_PLY);
+}
+
+/// Converts a score relative to the root into one relative to the node
+/// at the given ply, for storing in the transposition table.
+i32 score_to_tt(i32 score, u32 ply) {
+    if (is_win_score(score))
+        return score > 0 ? score + i32(ply) : score - i32(ply);
+    return score;
+}
+
+/// Converts a score from the transposition table into one relative to
+/// the root. This is the inverse of `score_to_tt`.
+i32 score_from_tt(i32 score, u32 ply) {
+    if (is_win_score(score))
+        return score > 0 ? score - i32(ply) : score + i32(ply);
+    return score;
+}
+
+/// Returns the transposition table key of a board with a stone to play.
+u64 tt_key(const Board &board, Stone stone) {
+    return board.hash() ^ (stone == Stone::White ? WHITE_TO_PLAY_KEY : 0);
+}
+
+/// A candidate move along with its ordering score.
+struct ScoredMove {
+    Point pos;
+    i32 score;
+};
+
+/// Threats that a move makes or meets.
+struct MoveThreats {
+    i32 score = 0;
+    bool wins = false;
+    bool blocks_five = false;
+};
+
+/// Rates a move by the windows through it, for both attack and defence.
+MoveThreats rate_move(const Board &board, Point p, Stone stone) {
+    Stone other = opposite(stone);
+    MoveThreats threats;
+    for (Axis axis : AXES) {
+        auto [line, bit] = line_pos(p, axis);
+        u16 own = board.line(stone, line), opp = board.line(other, line);
+        u16 valid = LINE_MASKS[line];
+
+        for (u32 k = bit >= 4 ? bit - 4 : 0; k <= bit && k + 5 <= 16; k++) {
+            if (((valid >> k) & WINDOW_MASK) != WINDOW_MASK)
+                continue;
+            int o = std::popcount(u16((own >> k) & WINDOW_MASK));
+            int e = std::popcount(u16((opp >> k) & WINDOW_MASK));
+            if (e == 0) {
+                threats.score += WINDOW_SCORES[o + 1] - WINDOW_SCORES[o];
+                threats.wins |= o == 4;
+            }
+            if (o == 0) {
+                threats.score += WINDOW_SCORES[e + 1] - WINDOW_SCORES[e];
+                threats.blocks_five |= e == 4;
+            }
+        }
+    }
+    return threats;
+}
+
+/// Checks if a move of the stone at a point would make a five that wins
+/// under the rule.
+bool makes_five(const Board &board, Point p, Stone stone, Rule rule) {
+    bool exact = exact_five(rule, stone);
+    for (Axis axis : AXES) {
+        Pattern pattern =
+            exact ? EXACT_PATTERN_TABLE[exact_pattern_window(board, p, stone,
+                                                             axis)]
+                  : PATTERN_TABLE[pattern_window(board, p, stone, axis)];
+        if (pattern == Pattern::Five)
+            return true;
+    }
+    return false;
+}
+
+/// Generates ordered moves for a stone under the rule, returning the
+/// number of moves.
+///
+/// Moves are restricted by the threats on the board: a winning move
+/// is returned alone, and a threat of five leaves only the blocks.
+/// Otherwise the best `MAX_BRANCHING` moves are returned. Moves that
+/// are illegal under the rule are left out; as the windows of the
+/// threats may make rows longer than five, fives are confirmed by
+/// pattern lookups where the rule requires exactly five.
+usize generate_moves(const Board &board, Stone stone,
+                     span<ScoredMove, BOARD_SIZE * BOARD_SIZE> out,
+                     Rule rule = Rule::Freestyle) {
+    BoardMask cand = board.candidates();
+    usize len = 0, blocks = 0;
+    Stone other = opposite(stone);
+    bool fouls = rule == Rule::Renju && stone == Stone::Black;
+
+    for (u32 y = 0; y < BOARD_SIZE; y++) {
+        for (u16 row = cand[y]; row != 0; row &= row - 1) {
+            Point p(std::countr_zero(row), y);
+            MoveThreats threats = rate_move(board, p, stone);
+            if (threats.wins && exact_five(rule, stone))
+                threats.wins = makes_five(board, p, stone, rule);
+            if (threats.blocks_five && exact_five(rule, other))
+                threats.blocks_five = makes_five(board, p, other, rule);
+            if (!threats.wins && fouls && renju_foul(board, p) != Foul::None)
+                continue;
+            if (threats.wins) {
+                out[0] = {p, WIN_SCORE};
+                return 1;
+            }
+            if (threats.blocks_five) {
+                // Keep the blocks at the front.
+                out[len++] = out[blocks];
+                out[blocks++] = {p, threats.score};
+            } else if (blocks == 0) {
+                out[len++] = {p, threats.score};
+            }
+        }
+    }
+
+    if (blocks != 0)
+        return blocks;
+    auto by_score = [](ScoredMove a, ScoredMove b) {
+        return a.score > b.score;
+    };
+    usize n = std::min(len, MAX_BRANCHING);
+    std::partial_sort(out.begin(), out.begin() + n, out.begin() + len,
+                      by_score);
+    return n;
+}
+
+/// Moves the move at a point (if among the moves) to the front.
+void move_to_front(span<ScoredMove> moves, optional<Point> p) {
+    if (!p)
+        return;
+    auto it = std::find_if(moves.begin(), moves.end(),
+                           [&](ScoredMove m) { return m.pos == *p; });
+    if (it != moves.end())
+        std::rotate(moves.begin(), it, it + 1);
+}
+
+/// Limits on a search. Zero means no limit.
+struct SearchLimits {
+    milliseconds time{1000};
+    u64 nodes = 0;
+    u32 depth = MAX_PLY;
+    /// A flag that stops the search once set, if not null. Unlike
+    /// `Engine::stop`, it also stops a search that has yet to start.
+    const std::atomic<bool> *cancel = nullptr;
+};
+
+/// The result of a search.
+struct SearchResult {
+    /// The best move found, if there is any move to play.
+    optional<Point> best;
+    /// The score of the best move, from the perspective of the stone.
+    i32 score = 0;
+    /// The depth of the last completed iteration.
+    u32 depth = 0;
+    /// The total number of nodes searched.
+    u64 nodes = 0;
+    /// The principal variation, starting with the best move.
+    vector<Point> pv;
+    /// The time elapsed since the search started.
+    milliseconds elapsed{0};
+    /// The time taken by each completed iteration, by depth from 1.
+    vector<milliseconds> depth_times;
+    /// The statistics of the search, all zero if compiled out.
+    SearchStats stats;
+};
+
+/// A handler of the progress of a search, called on a search thread.
+typedef std::function<void(const SearchResult &)> ProgressHandler;
+
+/// A multi-threaded alpha-beta search engine.
+///
+/// The engine searches with principal variation search under iterative
+/// deepening. At each depth, the first root move is searched alone to
+/// establish a bound, and then the remaining root moves are split among
+/// the threads, each taking the next unclaimed move.
+class Engine {
+    usize threads;
+    std::atomic<bool> stopped{false};
+    TranspositionTable tt;
+    const Book *book = nullptr;
+    const Network *network = nullptr;
+    ProgressHandler progress;
+    milliseconds progress_interval = PROGRESS_INTERVAL;
+
+    /// State shared among the threads of a search.
+    struct Shared {
+        std::atomic<bool> &stopped;
+        TranspositionTable &tt;
+        Rule rule;
+        const Network *network;
+        steady_clock::time_point deadline;
+        u64 node_limit;
+        const std::atomic<bool> *cancel;
+        std::atomic<u64> nodes{0};
+
+        // State of the current iteration.
+        std::atomic<usize> next_move{0};
+        std::mutex mutex{};
+        i32 alpha = 0;
+        usize best_index = 0;
+        vector<Point> best_pv{};
+
+        // Periodic progress reports, made by the first searcher alone.
+        std::function<void()> report{};
+        milliseconds report_interval{0};
+        steady_clock::time_point next_report{};
+
+        /// Checks the limits and stops the search if any is exceeded.
+        void check_limits() {
+            if ((node_limit != 0 && nodes >= node_limit) ||
+                steady_clock::now() >= deadline || (cancel && *cancel))
+                stopped = true;
+        }
+
+        /// Reports the progress if a report is due.
+        void report_if_due() {
+            if (!report)
+                return;
+            auto now = steady_clock::now();
+            if (now < next_report)
+                return;
+            next_report = now + report_interval;
+            report();
+        }
+    };
+
+    /// The state of one search thread.
+    class Searcher {
+        Board board;
+        Accumulator acc;
+        Shared &shared;
+        bool reports;
+        u64 pending_nodes = 0;
+        StatCounters stats;
+        Point pv[MAX_PLY + 1][MAX_PLY + 1];
+        u32 pv_len[MAX_PLY + 1];
+        ScoredMove moves[MAX_PLY + 1][BOARD_SIZE * BOARD_SIZE];
+
+      public:
+        Searcher(const Board &board, Shared &shared, bool reports)
+            : board(board), shared(shared), reports(reports) {
+            if (shared.network)
+                shared.network->refresh(acc, board);
+        }
+
+        /// Returns the statistics counters of the thread.
+        const StatCounters &counters() const { return stats; }
+
+        /// Flushes the nodes counted locally into the shared counter.
+        void flush_nodes() {
+            shared.nodes += pending_nodes;
+            pending_nodes = 0;
+        }
+
+        /// Searches a root move with the given window, returning its
+        /// score and writing the principal variation to `line`.
+        i32 search_root_move(Point p, Stone stone, u32 depth, i32 alpha,
+                             i32 beta, vector<Point> &line) {
+            place(p, stone);
+            i32 score = -search(opposite(stone), depth - 1, -beta, -alpha, 1);
+            remove(p, stone);
+
+            line.assign(1, p);
+            line.insert(line.end(), pv[1] + 1, pv[1] + pv_len[1]);
+            return score;
+        }
+
+      private:
+        /// Places a stone, keeping the accumulator up to date if a
+        /// network evaluates.
+        void place(Point p, Stone stone) {
+            board.set(p, stone);
+            if (shared.network)
+                shared.network->add(acc, p, stone);
+        }
+
+        /// Removes a stone placed by `place`.
+        void remove(Point p, Stone stone) {
+            board.unset(p);
+            if (shared.network)
+                shared.network->remove(acc, p, stone);
+        }
+
+        /// Evaluates the board statically from the perspective of a
+        /// stone, with the network if any.
+        i32 evaluate_leaf(Stone stone) const {
+            if (shared.network)
+                return shared.network->evaluate(acc, stone);
+            return evaluate(board, stone);
+        }
+
+        /// Searches a node with negamax, returning its score from the
+        /// perspective of the stone to play.
+        i32 search(Stone stone, u32 depth, i32 alpha, i32 beta, u32 ply) {
+            if (++pending_nodes == CHECK_INTERVAL) {
+                flush_nodes();
+                shared.check_limits();
+                if (reports)
+                    shared.report_if_due();
+            }
+            stats.add(Stat::Nodes);
+            pv_len[ply] = ply;
+            if (shared.stopped)
+                return 0;
+            if (depth == 0 || ply == MAX_PLY) {
+                stats.add(Stat::Leaves);
+                return evaluate_leaf(stone);
+            }
+
+            u64 key = tt_key(board, stone);
+            optional<Point> tt_move;
+            stats.add(Stat::TtProbes);
+            if (auto entry = shared.tt.probe(key)) {
+                stats.add(Stat::TtHits);
+                tt_move = entry->best();
+                i32 score = score_from_tt(entry->score, ply);
+                if (entry->depth >= depth &&
+                    (entry->bound == Bound::Exact ||
+                     (entry->bound == Bound::Lower && score >= beta) ||
+                     (entry->bound == Bound::Upper && score <= alpha)))
+                    return score;
+            }
+
+            usize n = generate_moves(board, stone, moves[ply], shared.rule);
+            if (n == 0)
+                return 0;
+            if (moves[ply][0].score == WIN_SCORE) {
+                pv[ply][ply] = moves[ply][0].pos;
+                pv_len[ply] = ply + 1;
+                return WIN_SCORE - i32(ply) - 1;
+            }
+            move_to_front({moves[ply], n}, tt_move);
+
+            i32 orig_alpha = alpha;
+            optional<Point> best;
+            for (usize i = 0; i < n; i++) {
+                Point p = moves[ply][i].pos;
+                place(p, stone);
+                i32 score;
+                if (i == 0) {
+                    score = -search(opposite(stone), depth - 1, -beta, -alpha,
+                                    ply + 1);
+                } else {
+                    score = -search(opposite(stone), depth - 1, -alpha - 1,
+                                    -alpha, ply + 1);
+                    if (score > alpha && score < beta)
+                        score = -search(opposite(stone), depth - 1, -beta,
+                                        -alpha, ply + 1);
+                }
+                remove(p, stone);
+
+                if (shared.stopped)
+                    return 0;
+                if (score > alpha) {
+                    alpha = score;
+                    best = p;
+                    pv[ply][ply] = p;
+                    std::copy(pv[ply + 1] + ply + 1,
+                              pv[ply + 1] + pv_len[ply + 1], pv[ply] + ply + 1);
+                    pv_len[ply] = pv_len[ply + 1];
+                    if (alpha >= beta) {
+                        stats.add(Stat::Cutoffs);
+                        if (i == 0)
+                            stats.add(Stat::FirstMoveCutoffs);
+                        break;
+                    }
+                }
+            }
+
+            Bound bound = alpha >= beta           ? Bound::Lower
+                          : alpha > orig_alpha ? Bound::Exact
+                                               : Bound::Upper;
+            shared.tt.store(key, best, depth, bound, score_to_tt(alpha, ply));
+            return alpha;
+        }
+    };
+
+  public:
+    /// Creates an engine with the given number of search threads and
+    /// the given size of the transposition table in MiB.
+    ///
+    /// The transposition table is kept across searches, so that
+    /// successive moves of the same game benefit from earlier work.
+    explicit Engine(usize threads = std::thread::hardware_concurrency(),
+                    usize hash_mb = 64)
+        : threads(std::max<usize>(threads, 1)), tt(hash_mb) {}
+
+    /// Resizes the transposition table. This must not be called during
+    /// a search.
+    void set_hash_size(usize mb) { tt.resize(mb); }
+
+    /// Clears the transposition table. This must not be called during
+    /// a search.
+    void clear_hash() { tt.clear(); }
+
+    /// Sets the opening book to consult before searching, or none if
+    /// null. The book must outlive the engine, and this must not be
+    /// called during a search.
+    void set_book(const Book *opening_book) { book = opening_book; }
+
+    /// Sets the network to evaluate positions with, or none if null, in
+    /// which case the pattern evaluation is used. The network must
+    /// outlive the engine, and this must not be called during a search.
+    void set_network(const Network *eval_network) { network = eval_network; }
+
+    /// Sets the handler of the progress of searches, or none if empty.
+    /// This must not be called during a search.
+    ///
+    /// The handler is called on the thread that started the search,
+    /// after each completed iteration and about every `interval` in
+    /// between, with the result of the last completed iteration along
+    /// with the statistics so far.
+    void set_progress_handler(ProgressHandler handler,
+                              milliseconds interval = PROGRESS_INTERVAL) {
+        progress = std::move(handler);
+        progress_interval = interval;
+    }
+
+    /// Stops the ongoing search (if any) as soon as possible.
+    ///
+    /// This may be called from any thread.
+    void stop() { stopped = true; }
+
+    /// Searches for the best move for a stone from a game snapshot,
+    /// under the rule of the game.
+    SearchResult search(const Game &game, Stone stone,
+                        const SearchLimits &limits) {
+        stopped = false;
+        const Board &board = game.position();
+        SearchResult result;
+
+        auto entry = book ? book->probe(board, stone) : nullopt;
+        if (entry && is_legal(board, entry->move, stone, game.rule())) {
+            result.best = entry->move;
+            result.score = entry->score;
+            result.pv = {entry->move};
+            return result;
+        }
+
+        ScoredMove root_moves[BOARD_SIZE * BOARD_SIZE];
+        usize n = generate_moves(board, stone, root_moves, game.rule());
+        if (n == 0) {
+            // Play in the center of an empty board.
+            Point center(BOARD_SIZE / 2, BOARD_SIZE / 2);
+            if (board.at(center) == Stone::None) {
+                result.best = center;
+                result.pv = {center};
+            }
+            return result;
+        }
+
+        tt.new_search();
+        if (auto entry = tt.probe(tt_key(board, stone)))
+            move_to_front({root_moves, n}, entry->best());
+
+        result.best = root_moves[0].pos;
+        result.pv = {root_moves[0].pos};
+        if (n == 1) {
+            // The move is either winning or forced.
+            if (root_moves[0].score == WIN_SCORE)
+                result.score = WIN_SCORE - 1;
+            return result;
+        }
+
+        auto start = steady_clock::now();
+        Shared shared{stopped,
+                      tt,
+                      game.rule(),
+                      network,
+                      limits.time.count() != 0
+                          ? start + limits.time
+                          : steady_clock::time_point::max(),
+                      limits.nodes,
+                      limits.cancel};
+
+        vector<std::unique_ptr<Searcher>> searchers;
+        for (usize i = 0; i < threads; i++)
+            searchers.push_back(
+                std::make_unique<Searcher>(board, shared, i == 0));
+
+        // Fill in the counts and the time so far, which other threads may
+        // be adding to, while the rest is only written by this thread.
+        auto update_counts = [&] {
+            result.nodes = shared.nodes;
+            result.elapsed = std::chrono::duration_cast<milliseconds>(
+                steady_clock::now() - start);
+            result.stats = {};
+            for (const auto &searcher : searchers)
+                result.stats += searcher->counters().snapshot();
+        };
+        if (progress) {
+            shared.report = [&] {
+                update_counts();
+                progress(result);
+            };
+            shared.report_interval = progress_interval;
+            shared.next_report = start + progress_interval;
+        }
+
+        u32 max_depth = limits.depth == 0 ? MAX_PLY : limits.depth;
+        for (u32 depth = 1; depth <= std::min(max_depth, MAX_PLY); depth++) {
+            auto iteration_start = steady_clock::now();
+
+            // Search the first move alone to establish a bound.
+            vector<Point> line;
+            i32 first = searchers[0]->search_root_move(
+                root_moves[0].pos, stone, depth, -WIN_SCORE, WIN_SCORE, line);
+            if (stopped)
+                break;
+
+            shared.next_move = 1;
+            shared.alpha = first;
+            shared.best_index = 0;
+            shared.best_pv = std::move(line);
+
+            auto work = [&](Searcher &searcher) {
+                vector<Point> line;
+                usize i;
+                while (!stopped && (i = shared.next_move++) < n) {
+                    Point p = root_moves[i].pos;
+                    i32 alpha;
+                    {
+                        std::lock_guard lock(shared.mutex);
+                        alpha = shared.alpha;
+                    }
+                    i32 score = searcher.search_root_move(
+                        p, stone, depth, alpha, alpha + 1, line);
+                    if (!stopped && score > alpha)
+                        score = searcher.search_root_move(
+                            p, stone, depth, alpha, WIN_SCORE, line);
+                    if (stopped)
+                        break;
+
+                    std::lock_guard lock(shared.mutex);
+                    if (score > shared.alpha) {
+                        shared.alpha = score;
+                        shared.best_index = i;
+                        shared.best_pv = line;
+                    }
+                }
+                searcher.flush_nodes();
+            };
+
+            vector<std::thread> helpers;
+            for (usize t = 1; t < threads; t++)
+                helpers.emplace_back(work, std::ref(*searchers[t]));
+            work(*searchers[0]);
+            for (std::thread &helper : helpers)
+                helper.join();
+
+            // An iteration cut short only proves that its best move
+            // scores at least as much, against the moves searched so far,
+            // so it counts as the last completed depth and is stored as a
+            // lower bound.
+            bool partial = stopped;
+            if (partial && depth > 1) {
+                // Keep the result of the last completed iteration,
+                // unless a better move has been proven already.
+                if (shared.best_index == 0)
+                    break;
+            }
+
+            std::swap(root_moves[0], root_moves[shared.best_index]);
+            result.best = root_moves[0].pos;
+            result.score = shared.alpha;
+            result.depth = partial ? depth - 1 : depth;
+            result.pv = shared.best_pv;
+            tt.store(tt_key(board, stone), result.best, depth,
+                     partial ? Bound::Lower : Bound::Exact, result.score);
+            if (!partial)
+                result.depth_times.push_back(
+                    std::chrono::duration_cast<milliseconds>(
+                        steady_clock::now() - iteration_start));
+            if (progress) {
+                searchers[0]->flush_nodes();
+                update_counts();
+                progress(result);
+            }
+
+            if (stopped || is_win_score(result.score))
+                break;
+        }
+
+        searchers[0]->flush_nodes();
+        update_counts();
+        return result;
+    }
+};
@@ -0,0 +1,317 @@
+#pragma once
+
+#include "core.hpp"
+#include "simd.hpp"
+
+/// Score of a position won on the spot. A win in `n` plies scores
+/// `WIN_SCORE - n`, so that quicker wins are preferred.
+const i32 WIN_SCORE = 1'000'000;
+
+/// Scores of a 5-cell window, indexed by the number of stones of
+/// a single colour in it, provided that there are none of the other.
+const i32 WINDOW_SCORES[] = {0, 1, 12, 150, 2000, WIN_SCORE};
+
+/// Mask of the five lowest bits, namely a window on a line.
+const u16 WINDOW_MASK = 0x1f;
+
+/// Number of window positions on a line, which is at most as long
+/// as a side of the board.
+const u32 WINDOW_OFFSETS = BOARD_SIZE - 5 + 1;
+
+// The vectorised kernels process lines 8 at a time.
+static_assert(LINE_COUNT % 8 == 0);
+
+/// Scores the 5-cell windows on a line from the perspective of
+/// `own` stones against `opp` stones.
+i32 score_line(u16 own, u16 opp, u16 valid) {
+    i32 score = 0;
+    for (u32 k = 0; k < WINDOW_OFFSETS; k++) {
+        if (((valid >> k) & WINDOW_MASK) != WINDOW_MASK)
+            continue;
+        u16 o = (own >> k) & WINDOW_MASK, e = (opp >> k) & WINDOW_MASK;
+        if (e == 0)
+            score += WINDOW_SCORES[std::popcount(o)];
+        else if (o == 0)
+            score -= WINDOW_SCORES[std::popcount(e)];
+    }
+    return score;
+}
+
+/// Evaluates the board statically from the perspective of a stone,
+/// one window at a time. This is the reference for the vectorised
+/// kernels, which must agree with it exactly.
+i32 evaluate_scalar(const Board &board, Stone stone) {
+    Stone other = opposite(stone);
+    i32 score = 0;
+    for (usize i = 0; i < LINE_COUNT; i++) {
+        score += score_line(board.line(stone, i), board.line(other, i),
+                            LINE_MASKS[i]);
+    }
+    return score;
+}
+
+/// Returns the change in the static evaluation from the perspective of
+/// a stone when it moves at an empty point. Only the windows through the
+/// point change, so no others are looked at.
+i32 evaluate_move(const Board &board, Point p, Stone stone) {
+    Stone other = opposite(stone);
+    i32 delta = 0;
+    for (Axis axis : AXES) {
+        auto [line, bit] = line_pos(p, axis);
+        u16 own = board.line(stone, line), opp = board.line(other, line);
+        u16 valid = LINE_MASKS[line];
+        for (u32 k = bit >= 4 ? bit - 4 : 0; k <= bit && k + 5 <= 16; k++) {
+            if (((valid >> k) & WINDOW_MASK) != WINDOW_MASK)
+                continue;
+            int o = std::popcount(u16((own >> k) & WINDOW_MASK));
+            int e = std::popcount(u16((opp >> k) & WINDOW_MASK));
+            // A window of the other stone alone no longer counts against.
+            if (e == 0)
+                delta += WINDOW_SCORES[o + 1] - WINDOW_SCORES[o];
+            else if (o == 0)
+                delta += WINDOW_SCORES[e];
+        }
+    }
+    return delta;
+}
+
+/// Sums window counts into a score, where `counts[c - 1]` is the number
+/// of windows with `c` own stones and none of the other, minus the
+/// number of windows the other way round.
+i32 score_window_counts(const i32 counts[5]) {
+    i32 score = 0;
+    for (usize c = 1; c <= 5; c++)
+        score += WINDOW_SCORES[c] * counts[c - 1];
+    return score;
+}
+
+// All kernels below count windows by the number of stones in lanes
+// of 16 bits, one line per lane, and then sum the counts into a score.
+// Per lane, a count never exceeds the number of windows on all lines
+// processed in the lane, so 16 bits are enough.
+
+#ifdef GOMOKU_SIMD_X86
+
+/// Counts the set bits in each 16-bit lane holding at most 8 bits.
+__m128i popcount8_epi16(__m128i x) {
+    x = _mm_sub_epi16(x, _mm_and_si128(_mm_srli_epi16(x, 1),
+                                       _mm_set1_epi16(0x55)));
+    x = _mm_add_epi16(_mm_and_si128(x, _mm_set1_epi16(0x33)),
+                      _mm_and_si128(_mm_srli_epi16(x, 2),
+                                    _mm_set1_epi16(0x33)));
+    return _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 4)),
+                         _mm_set1_epi16(0x0f));
+}
+
+/// Sums the 16-bit lanes.
+i32 hsum_epi16(__m128i x) {
+    __m128i sum = _mm_madd_epi16(x, _mm_set1_epi16(1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+/// Counts windows on 8 lines with SSE2.
+void count_windows_sse2(const u16 *own, const u16 *opp, const u16 *valid,
+                        __m128i own_counts[5], __m128i opp_counts[5]) {
+    const __m128i window = _mm_set1_epi16(WINDOW_MASK);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i own_line = _mm_loadu_si128((const __m128i *)own);
+    __m128i opp_line = _mm_loadu_si128((const __m128i *)opp);
+    __m128i valid_line = _mm_loadu_si128((const __m128i *)valid);
+
+    for (u32 k = 0; k < WINDOW_OFFSETS; k++) {
+        __m128i shift = _mm_cvtsi32_si128(k);
+        __m128i o = _mm_and_si128(_mm_srl_epi16(own_line, shift), window);
+        __m128i e = _mm_and_si128(_mm_srl_epi16(opp_line, shift), window);
+        __m128i v = _mm_cmpeq_epi16(
+            _mm_and_si128(_mm_srl_epi16(valid_line, shift), window), window);
+
+        __m128i own_only = _mm_and_si128(v, _mm_cmpeq_epi16(e, zero));
+        __m128i opp_only = _mm_and_si128(v, _mm_cmpeq_epi16(o, zero));
+        __m128i own_pop = popcount8_epi16(o), opp_pop = popcount8_epi16(e);
+        for (int c = 1; c <= 5; c++) {
+            __m128i n = _mm_set1_epi16(c);
+            // A true comparison is -1, so subtracting it counts one.
+            own_counts[c - 1] = _mm_sub_epi16(
+                own_counts[c - 1],
+                _mm_and_si128(own_only, _mm_cmpeq_epi16(own_pop, n)));
+            opp_counts[c - 1] = _mm_sub_epi16(
+                opp_counts[c - 1],
+                _mm_and_si128(opp_only, _mm_cmpeq_epi16(opp_pop, n)));
+        }
+    }
+}
+
+/// Evaluates the board with SSE2, 8 lines at a time.
+i32 evaluate_sse2(const Board &board, Stone stone) {
+    const u16 *own = board.line_masks(stone).data();
+    const u16 *opp = board.line_masks(opposite(stone)).data();
+    __m128i own_counts[5], opp_counts[5];
+    for (int c = 0; c < 5; c++)
+        own_counts[c] = opp_counts[c] = _mm_setzero_si128();
+
+    for (usize i = 0; i < LINE_COUNT; i += 8) {
+        count_windows_sse2(own + i, opp + i, LINE_MASKS.data() + i, own_counts,
+                           opp_counts);
+    }
+
+    i32 counts[5];
+    for (int c = 0; c < 5; c++)
+        counts[c] = hsum_epi16(own_counts[c]) - hsum_epi16(opp_counts[c]);
+    return score_window_counts(counts);
+}
+
+/// Counts the set bits in each 16-bit lane holding at most 8 bits.
+GOMOKU_TARGET_AVX2 __m256i popcount8_epi16_avx2(__m256i x) {
+    x = _mm256_sub_epi16(x, _mm256_and_si256(_mm256_srli_epi16(x, 1),
+                                             _mm256_set1_epi16(0x55)));
+    x = _mm256_add_epi16(_mm256_and_si256(x, _mm256_set1_epi16(0x33)),
+                         _mm256_and_si256(_mm256_srli_epi16(x, 2),
+                                          _mm256_set1_epi16(0x33)));
+    return _mm256_and_si256(_mm256_add_epi16(x, _mm256_srli_epi16(x, 4)),
+                            _mm256_set1_epi16(0x0f));
+}
+
+/// Evaluates the board with AVX2, 16 lines at a time, leaving the
+/// last 8 lines (if any) to SSE2.
+GOMOKU_TARGET_AVX2 i32 evaluate_avx2(const Board &board, Stone stone) {
+    const u16 *own = board.line_masks(stone).data();
+    const u16 *opp = board.line_masks(opposite(stone)).data();
+    const __m256i window = _mm256_set1_epi16(WINDOW_MASK);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i own_counts[5], opp_counts[5];
+    for (int c = 0; c < 5; c++)
+        own_counts[c] = opp_counts[c] = _mm256_setzero_si256();
+
+    usize i = 0;
+    for (; i + 16 <= LINE_COUNT; i += 16) {
+        __m256i own_line = _mm256_loadu_si256((const __m256i *)(own + i));
+        __m256i opp_line = _mm256_loadu_si256((const __m256i *)(opp + i));
+        __m256i valid_line =
+            _mm256_loadu_si256((const __m256i *)(LINE_MASKS.data() + i));
+
+        for (u32 k = 0; k < WINDOW_OFFSETS; k++) {
+            __m128i shift = _mm_cvtsi32_si128(k);
+            __m256i o =
+                _mm256_and_si256(_mm256_srl_epi16(own_line, shift), window);
+            __m256i e =
+                _mm256_and_si256(_mm256_srl_epi16(opp_line, shift), window);
+            __m256i v = _mm256_cmpeq_epi16(
+                _mm256_and_si256(_mm256_srl_epi16(valid_line, shift), window),
+                window);
+
+            __m256i own_only =
+                _mm256_and_si256(v, _mm256_cmpeq_epi16(e, zero));
+            __m256i opp_only =
+                _mm256_and_si256(v, _mm256_cmpeq_epi16(o, zero));
+            __m256i own_pop = popcount8_epi16_avx2(o);
+            __m256i opp_pop = popcount8_epi16_avx2(e);
+            for (int c = 1; c <= 5; c++) {
+                __m256i n = _mm256_set1_epi16(c);
+                __m256i own_eq = _mm256_cmpeq_epi16(own_pop, n);
+                __m256i opp_eq = _mm256_cmpeq_epi16(opp_pop, n);
+                own_counts[c - 1] = _mm256_sub_epi16(
+                    own_counts[c - 1], _mm256_and_si256(own_only, own_eq));
+                opp_counts[c - 1] = _mm256_sub_epi16(
+                    opp_counts[c - 1], _mm256_and_si256(opp_only, opp_eq));
+            }
+        }
+    }
+
+    __m128i own_tail[5], opp_tail[5];
+    for (int c = 0; c < 5; c++) {
+        own_tail[c] = _mm_add_epi16(_mm256_castsi256_si128(own_counts[c]),
+                                    _mm256_extracti128_si256(own_counts[c], 1));
+        opp_tail[c] = _mm_add_epi16(_mm256_castsi256_si128(opp_counts[c]),
+                                    _mm256_extracti128_si256(opp_counts[c], 1));
+    }
+    for (; i < LINE_COUNT; i += 8) {
+        count_windows_sse2(own + i, opp + i, LINE_MASKS.data() + i, own_tail,
+                           opp_tail);
+    }
+
+    i32 counts[5];
+    for (int c = 0; c < 5; c++)
+        counts[c] = hsum_epi16(own_tail[c]) - hsum_epi16(opp_tail[c]);
+    return score_window_counts(counts);
+}
+
+#endif
+
+#ifdef GOMOKU_SIMD_NEON
+
+/// Evaluates the board with NEON, 8 lines at a time.
+i32 evaluate_neon(const Board &board, Stone stone) {
+    const u16 *own = board.line_masks(stone).data();
+    const u16 *opp = board.line_masks(opposite(stone)).data();
+    const uint16x8_t window = vdupq_n_u16(WINDOW_MASK);
+    uint16x8_t own_counts[5], opp_counts[5];
+    for (int c = 0; c < 5; c++)
+        own_counts[c] = opp_counts[c] = vdupq_n_u16(0);
+
+    for (usize i = 0; i < LINE_COUNT; i += 8) {
+        uint16x8_t own_line = vld1q_u16(own + i);
+        uint16x8_t opp_line = vld1q_u16(opp + i);
+        uint16x8_t valid_line = vld1q_u16(LINE_MASKS.data() + i);
+
+        for (u32 k = 0; k < WINDOW_OFFSETS; k++) {
+            // Shifting left by a negative amount shifts right.
+            int16x8_t shift = vdupq_n_s16(-std::int16_t(k));
+            uint16x8_t o = vandq_u16(vshlq_u16(own_line, shift), window);
+            uint16x8_t e = vandq_u16(vshlq_u16(opp_line, shift), window);
+            uint16x8_t v = vceqq_u16(
+                vandq_u16(vshlq_u16(valid_line, shift), window), window);
+
+            uint16x8_t own_only = vandq_u16(v, vceqzq_u16(e));
+            uint16x8_t opp_only = vandq_u16(v, vceqzq_u16(o));
+            // The high byte of each lane is zero, so the byte counts
+            // read as lane counts.
+            uint16x8_t own_pop =
+                vreinterpretq_u16_u8(vcntq_u8(vreinterpretq_u8_u16(o)));
+            uint16x8_t opp_pop =
+                vreinterpretq_u16_u8(vcntq_u8(vreinterpretq_u8_u16(e)));
+            for (int c = 1; c <= 5; c++) {
+                uint16x8_t n = vdupq_n_u16(c);
+                uint16x8_t own_eq = vceqq_u16(own_pop, n);
+                uint16x8_t opp_eq = vceqq_u16(opp_pop, n);
+                // A true comparison is all ones, so subtracting it
+                // counts one.
+                own_counts[c - 1] =
+                    vsubq_u16(own_counts[c - 1], vandq_u16(own_only, own_eq));
+                opp_counts[c - 1] =
+                    vsubq_u16(opp_counts[c - 1], vandq_u16(opp_only, opp_eq));
+            }
+        }
+    }
+
+    i32 counts[5];
+    for (int c = 0; c < 5; c++)
+        counts[c] = i32(vaddvq_u16(own_counts[c])) -
+                    i32(vaddvq_u16(opp_counts[c]));
+    return score_window_counts(counts);
+}
+
+#endif
+
+/// An evaluation kernel.
+typedef i32 (*EvalKernel)(const Board &, Stone);
+
+/// Selects the fastest evaluation kernel supported at run time.
+EvalKernel select_eval_kernel() {
+#if defined(GOMOKU_SIMD_X86)
+    return cpu_has_avx2() ? evaluate_avx2 : evaluate_sse2;
+#elif defined(GOMOKU_SIMD_NEON)
+    return evaluate_neon;
+#else
+    return evaluate_scalar;
+#endif
+}
+
+/// The evaluation kernel selected at startup.
+const EvalKernel EVAL_KERNEL = select_eval_kernel();
+
+/// Evaluates the board statically from the perspective of a stone.
+i32 evaluate(const Board &board, Stone stone) {
+    return EVAL_KERNEL(board, stone);
+}
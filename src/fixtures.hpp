@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+#include <QFile>
+
+#include "core.hpp"
+#include "game.hpp"
+#include "uri.hpp"
+
+/// A game to benchmark or test on, decoded from the list of notable
+/// games.
+struct Fixture {
+    std::string name;
+    Game game;
+};
+
+/// Loads the games from a list in the format of `notable-games.md`,
+/// where each game URI follows a list item naming it, skipping the
+/// games without moves, as there is nothing to measure on them.
+optional<vector<Fixture>> load_fixtures(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return nullopt;
+
+    vector<Fixture> fixtures;
+    UriCodec codec;
+    Game game;
+    std::string name;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.startsWith("- ")) {
+            name = line.mid(2).toStdString();
+        } else if (line.startsWith(URI_PREFIX)) {
+            if (!codec.decode({line.constData(), usize(line.size())}, game))
+                return nullopt;
+            if (game.total_moves() != 0)
+                fixtures.push_back({name, game});
+        }
+    }
+    return fixtures;
+}
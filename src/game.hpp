@@ -0,0 +1,576 @@
+#pragma once
+
+#include <QByteArray>
+
+#include "core.hpp"
+#include "rules.hpp"
+
+/// Number of moves between two board snapshots kept by a game.
+///
+/// A snapshot costs a copy of the board, about as much as replaying a
+/// few moves, so a short interval keeps random jumps cheap while a full
+/// game still keeps only a few kilobytes of snapshots.
+const usize SNAPSHOT_INTERVAL = 8;
+
+/// A gomoku game on an `N` x `N` board, namely a tree of variations of
+/// moves.
+///
+/// The moves are nodes in an arena, each holding the index of its
+/// parent, its first child, its next sibling, and the child selected to
+/// continue the line through it. The current line follows the selected
+/// children from the root, and is cached as a vector of moves along with
+/// the nodes, so that switching variations only rewrites the cache past
+/// the branching point, and no branch is ever copied or discarded.
+///
+/// The game keeps a snapshot of the board after every
+/// `SNAPSHOT_INTERVAL` moves of the current line, so that a jump restores
+/// the nearest snapshot below the target and replays fewer than that many
+/// moves. As a board holds at most `N * N` stones, there are only a few
+/// dozen snapshots.
+///
+/// Moves are checked against the rule variant of the game, which also
+/// decides what counts as a win.
+template <usize N> class BasicGame {
+    /// The position code of a point, namely `y * N + x`.
+    typedef std::conditional_t<(N * N <= 0x100), u8, u16> Code;
+
+    /// A node in the tree of variations.
+    ///
+    /// Index 0 is the root, which holds no move, so that 0 can mark the
+    /// absence of a node.
+    struct Node {
+        Code pos;
+        Stone stone;
+        u32 parent;
+        u32 first_child = 0;
+        u32 next_sibling = 0;
+        u32 selected = 0;
+
+        Move move() const {
+            return {{u32(pos % N), u32(pos / N)}, stone};
+        }
+    };
+
+    Rule variant = Rule::Freestyle;
+    BasicBoard<N> board;
+    vector<Node> tree{Node{0, Stone::None, 0}};
+    /// The nodes and the moves of the current line.
+    vector<u32> line;
+    vector<Move> moves;
+    usize index = 0;
+    optional<Win> win;
+    /// Boards after `i * SNAPSHOT_INTERVAL` moves, for every such count
+    /// of moves up to the total.
+    vector<BasicBoard<N>> snapshots{BasicBoard<N>()};
+
+    /// Control bytes used in serialization.
+    ///
+    /// A variation follows the move it is an alternative to, enclosed in
+    /// `BEGIN_VARIATION` and `END_VARIATION`, which never appear in a game
+    /// without variations, so that such a game serializes to the same
+    /// linear bytes as before.
+    ///
+    /// A board whose position codes do not all fit below the control
+    /// bytes takes two bytes per code, high byte first, which is never a
+    /// control byte. The bytes of such a board must then start with
+    /// `HEADER`, followed by `HEADER_VERSION` and the board size, which
+    /// is optional for smaller boards, so that their bytes are unchanged.
+    enum CtrlByte : u8 {
+        BEGIN_SEQUENCE = 0xff,
+        END_SEQUENCE = 0xfe,
+        BEGIN_VARIATION = 0xfd,
+        END_VARIATION = 0xfc,
+        HEADER = 0xfb,
+    };
+
+    /// Version of the serialization format written in the header.
+    static const u8 HEADER_VERSION = 1;
+
+    /// Whether position codes take two bytes.
+    static constexpr bool WIDE = N * N > CtrlByte::HEADER;
+
+    /// Number of bytes per position code.
+    static constexpr usize CODE_BYTES = WIDE ? 2 : 1;
+
+    /// Appends the header to a buffer if the board requires it.
+    static void append_header(QByteArray &buf) {
+        if constexpr (WIDE) {
+            buf.append(char(CtrlByte::HEADER));
+            buf.append(char(HEADER_VERSION));
+            buf.append(char(N));
+        }
+    }
+
+    /// Appends a position code to a buffer.
+    static void append_code(QByteArray &buf, u32 code) {
+        if constexpr (WIDE)
+            buf.append(char(code >> 8));
+        buf.append(char(code & 0xff));
+    }
+
+    /// Returns the node at the current move index.
+    u32 current_node() const { return index == 0 ? 0 : line[index - 1]; }
+
+    /// Returns the child of a node with a move, adding it if absent.
+    u32 add_child(u32 parent, Move move) {
+        Code pos = move.pos.y * N + move.pos.x;
+        u32 *link = &tree[parent].first_child;
+        while (*link != 0) {
+            const Node &node = tree[*link];
+            if (node.pos == pos && node.stone == move.stone)
+                return *link;
+            link = &tree[*link].next_sibling;
+        }
+        u32 child = tree.size();
+        *link = child;
+        tree.push_back({pos, move.stone, parent});
+        if (tree[parent].selected == 0)
+            tree[parent].selected = child;
+        return child;
+    }
+
+    /// Appends a node to the current line, given the board after its
+    /// move, and brings the snapshots and the first win up to date.
+    void append_line(u32 n, const BasicBoard<N> &after) {
+        Move move = tree[n].move();
+        line.push_back(n);
+        moves.push_back(move);
+        if (moves.size() % SNAPSHOT_INTERVAL == 0)
+            snapshots.push_back(after);
+        if (!win) {
+            if (auto win_row = after.find_win_row(move.pos, variant))
+                win = {moves.size(), *win_row};
+        }
+    }
+
+    /// Extends the current line, which must end at the current move
+    /// index, along the selected children, and brings the snapshots and
+    /// the first win up to date with it.
+    void extend_line() {
+        BasicBoard<N> b = board;
+        u32 last = current_node();
+        for (u32 n = tree[last].selected; n != 0; n = tree[n].selected) {
+            Move move = tree[n].move();
+            b.set(move.pos, move.stone);
+            append_line(n, b);
+        }
+    }
+
+    /// Drops the current line past the current move index.
+    void truncate_line() {
+        line.resize(index);
+        moves.resize(index);
+        snapshots.resize(index / SNAPSHOT_INTERVAL + 1);
+        if (win && win->index > index)
+            win = nullopt;
+    }
+
+    /// Serializes the line from a node on along the selected children,
+    /// when the stone to play before the node is `stone`, with each move
+    /// followed by its variations, except the first move if `nested`.
+    void serialize_line(u32 first, Stone stone, bool nested,
+                        QByteArray &buf) const {
+        Stone last_stone = Stone::None;
+        bool in_sequence = false;
+        for (u32 n = first; n != 0; n = tree[n].selected) {
+            const Node &node = tree[n];
+            if (last_stone == Stone::None && node.stone != stone) {
+                buf.append(CtrlByte::BEGIN_SEQUENCE);
+                buf.append(CtrlByte::END_SEQUENCE);
+            }
+            if (last_stone == node.stone) {
+                if (!in_sequence) {
+                    buf.insert(buf.size() - CODE_BYTES,
+                               CtrlByte::BEGIN_SEQUENCE);
+                    in_sequence = true;
+                }
+            } else if (in_sequence) {
+                buf.append(CtrlByte::END_SEQUENCE);
+                in_sequence = false;
+            }
+            append_code(buf, node.pos);
+            last_stone = node.stone;
+
+            const Node &parent = tree[node.parent];
+            if ((nested && n == first) ||
+                (parent.first_child == n && node.next_sibling == 0))
+                continue;
+
+            // A variation may not start within a sequence, so end it here
+            // and start anew after the variations.
+            if (in_sequence) {
+                buf.append(CtrlByte::END_SEQUENCE);
+                in_sequence = false;
+            }
+            for (u32 c = parent.first_child; c != 0; c = tree[c].next_sibling) {
+                if (c == n)
+                    continue;
+                buf.append(CtrlByte::BEGIN_VARIATION);
+                serialize_line(c, node.stone, true, buf);
+                buf.append(CtrlByte::END_VARIATION);
+            }
+            stone = opposite(node.stone);
+            last_stone = Stone::None;
+        }
+
+        if (in_sequence)
+            buf.append(CtrlByte::END_SEQUENCE);
+    }
+
+  public:
+    /// Creates an empty game under the rule.
+    explicit BasicGame(Rule rule = Rule::Freestyle) : variant(rule) {}
+
+    /// Compares the rules, the current lines and the move indices of two
+    /// games, regardless of other variations.
+    bool operator==(const BasicGame &other) const {
+        return variant == other.variant && moves == other.moves &&
+               index == other.index;
+    }
+
+    /// Returns the rule of the game.
+    Rule rule() const { return variant; }
+
+    /// Changes the rule of the game, finding the first win in the
+    /// current line anew. Moves already made are kept even if they are
+    /// illegal under the new rule.
+    void set_rule(Rule rule) {
+        variant = rule;
+        usize to_index = index;
+        board = BasicBoard<N>();
+        index = 0;
+        win = nullopt;
+        truncate_line();
+        extend_line();
+        jump(to_index);
+    }
+
+    /// Returns the total number of moves in the current line, on or off
+    /// the board, in the past or in the future.
+    usize total_moves() const { return moves.size(); }
+
+    /// Returns the current move index.
+    usize move_index() const { return index; }
+
+    /// Returns a span of moves in the past.
+    span<const Move> past_moves() const { return {moves.data(), index}; }
+
+    /// Returns a span of moves in the future of the current line.
+    span<const Move> future_moves() const {
+        return {moves.data() + index, moves.size() - index};
+    }
+
+    /// Returns the first win witnessed in the past (if any).
+    optional<Win> first_win() const {
+        if (win && win->index <= index)
+            return win;
+        else
+            return nullopt;
+    }
+
+    /// Gets the stone at a point.
+    Stone stone_at(Point p) const { return board.at(p); }
+
+    /// Returns the board at the current move index.
+    const BasicBoard<N> &position() const { return board; }
+
+    /// Returns the Zobrist hash of the board at the current move index.
+    u64 hash() const { return board.hash(); }
+
+    /// Makes a move at a point, unless it is occupied or the move is
+    /// illegal under the rule.
+    ///
+    /// If the move differs from the next one in the current line, it
+    /// starts a new variation, and the old future is kept as another.
+    /// If it is already a variation, the line switches to it.
+    bool make_move(Point p, Stone stone) {
+        if (!is_legal(board, p, stone, variant))
+            return false;
+
+        u32 child = add_child(current_node(), {p, stone});
+        tree[current_node()].selected = child;
+        truncate_line();
+        board.set(p, stone);
+        append_line(child, board);
+        index += 1;
+        extend_line();
+        return true;
+    }
+
+    /// Returns the number of variations of the next move, namely the
+    /// children of the current node.
+    usize variation_count() const {
+        usize count = 0;
+        for (u32 c = tree[current_node()].first_child; c != 0;
+             c = tree[c].next_sibling)
+            count++;
+        return count;
+    }
+
+    /// Returns the index of the variation of the next move in the
+    /// current line, among `variation_count()` ones in order of creation.
+    usize variation_index() const {
+        const Node &node = tree[current_node()];
+        usize i = 0;
+        for (u32 c = node.first_child; c != node.selected;
+             c = tree[c].next_sibling)
+            i++;
+        return i;
+    }
+
+    /// Switches the current line to a variation of the next move.
+    bool select_variation(usize i) {
+        u32 c = tree[current_node()].first_child;
+        for (; c != 0 && i != 0; i--)
+            c = tree[c].next_sibling;
+        if (c == 0 || c == tree[current_node()].selected)
+            return false;
+
+        tree[current_node()].selected = c;
+        truncate_line();
+        extend_line();
+        return true;
+    }
+
+    /// Undoes the last move (if any).
+    bool undo() {
+        if (index == 0)
+            return false;
+        index -= 1;
+        Move last = moves.at(index);
+        board.unset(last.pos);
+        return true;
+    }
+
+    /// Redoes the next move (if any).
+    bool redo() {
+        if (index >= moves.size())
+            return false;
+        Move next = moves.at(index);
+        index += 1;
+        board.set(next.pos, next.stone);
+        return true;
+    }
+
+    /// Jumps to the given move index by undoing or redoing moves.
+    bool jump(usize to_index) {
+        if (to_index > moves.size())
+            throw std::out_of_range("move index out of range");
+        if (index == to_index)
+            return false;
+
+        // Restore the nearest snapshot if that takes fewer moves.
+        usize distance = index > to_index ? index - to_index : to_index - index;
+        if (to_index % SNAPSHOT_INTERVAL < distance) {
+            usize from = to_index - to_index % SNAPSHOT_INTERVAL;
+            board = snapshots[from / SNAPSHOT_INTERVAL];
+            for (usize i = from; i < to_index; i++)
+                board.set(moves[i].pos, moves[i].stone);
+        } else if (index > to_index) {
+            for (usize i = index; i > to_index; i--) {
+                Move last = moves.at(i - 1);
+                board.unset(last.pos);
+            }
+        } else {
+            for (usize i = index; i < to_index; i++) {
+                Move next = moves.at(i);
+                board.set(next.pos, next.stone);
+            }
+        }
+        index = to_index;
+        return true;
+    }
+
+    /// Infers the next stone to play, based on past moves.
+    Stone infer_turn() const {
+        return index == 0 ? Stone::Black : opposite(moves.at(index - 1).stone);
+    }
+
+    /// Serializes the past moves of the current line into a byte array.
+    QByteArray serialize() const {
+        QByteArray buf;
+        serialize_into(buf);
+        return buf;
+    }
+
+    /// Serializes the past moves of the current line, appending the bytes
+    /// to a buffer.
+    void serialize_into(QByteArray &buf) const {
+        usize start = buf.size();
+        auto moves = past_moves();
+        buf.reserve(start + moves.size() * CODE_BYTES + 5);
+        append_header(buf);
+
+        if (!moves.empty() && moves[0].stone == Stone::White) {
+            buf.append(CtrlByte::BEGIN_SEQUENCE);
+            buf.append(CtrlByte::END_SEQUENCE);
+        }
+
+        Stone last_stone = Stone::None;
+        bool in_sequence = false;
+        for (auto [pos, stone] : moves) {
+            if (last_stone == stone) {
+                if (!in_sequence) {
+                    buf.insert(buf.size() - CODE_BYTES,
+                               CtrlByte::BEGIN_SEQUENCE);
+                    in_sequence = true;
+                }
+            } else if (in_sequence) {
+                buf.append(CtrlByte::END_SEQUENCE);
+                in_sequence = false;
+            }
+            append_code(buf, pos.y * N + pos.x);
+            last_stone = stone;
+        }
+
+        if (in_sequence)
+            buf.append(CtrlByte::END_SEQUENCE);
+    }
+
+    /// Serializes the whole tree of variations into a byte array.
+    QByteArray serialize_tree() const {
+        QByteArray buf;
+        serialize_tree_into(buf);
+        return buf;
+    }
+
+    /// Serializes the whole tree of variations, appending the bytes to a
+    /// buffer, with the current line as the main one.
+    ///
+    /// A tree without variations gives the same bytes as
+    /// `serialize_into` after a jump to its end.
+    void serialize_tree_into(QByteArray &buf) const {
+        buf.reserve(buf.size() + tree.size() * CODE_BYTES + 5);
+        append_header(buf);
+        serialize_line(tree[0].selected, Stone::Black, false, buf);
+    }
+
+    /// Deserializes the byte array into a game under the rule.
+    static optional<BasicGame> deserialize(const QByteArray &buf,
+                                           Rule rule = Rule::Freestyle) {
+        BasicGame game(rule);
+        auto bytes = reinterpret_cast<const u8 *>(buf.constData());
+        if (!deserialize({bytes, usize(buf.size())}, game))
+            return nullopt;
+        return game;
+    }
+
+    /// Deserializes the bytes into a game, reusing its storage, so that no
+    /// allocation happens once it has grown large enough.
+    ///
+    /// The bytes may hold variations, and the game ends up at the end of
+    /// the main line. The moves are checked against the rule of the game,
+    /// which is kept. Returns `false` if the bytes are invalid, in which
+    /// case the game is left in an unspecified but valid state.
+    static bool deserialize(span<const u8> buf, BasicGame &game) {
+        game.board = BasicBoard<N>();
+        game.tree.resize(1);
+        game.tree[0] = Node{0, Stone::None, 0};
+        game.tree.reserve(buf.size() + 1);
+        game.line.clear();
+        game.line.reserve(buf.size());
+        game.moves.clear();
+        game.moves.reserve(buf.size());
+        game.index = 0;
+        game.win = nullopt;
+        game.snapshots.resize(1);
+        game.snapshots[0] = BasicBoard<N>();
+
+        // The board follows the node being read, and each open variation
+        // keeps the move that it is an alternative to. Until a variation
+        // is read, the moves read are the main line, which is built as it
+        // is read, so that linear bytes are replayed only once.
+        u32 node = 0;
+        vector<u32> open;
+        bool linear = true;
+        Stone stone = Stone::Black;
+        bool in_sequence = false;
+
+        usize i = 0;
+        if (!buf.empty() && buf[0] == CtrlByte::HEADER) {
+            if (buf.size() < 3 || buf[1] != HEADER_VERSION || buf[2] != N)
+                return false;
+            i = 3;
+        } else if (WIDE) {
+            return false;
+        }
+
+        for (; i < buf.size(); i++) {
+            u8 byte = buf[i];
+            if (byte == CtrlByte::BEGIN_SEQUENCE) {
+                if (in_sequence)
+                    return false;
+                in_sequence = true;
+                continue;
+            }
+            if (byte == CtrlByte::END_SEQUENCE) {
+                if (!in_sequence)
+                    return false;
+                in_sequence = false;
+                stone = opposite(stone);
+                continue;
+            }
+            if (byte == CtrlByte::BEGIN_VARIATION) {
+                if (in_sequence || node == 0)
+                    return false;
+                linear = false;
+                open.push_back(node);
+                game.board.unset(game.tree[node].move().pos);
+                stone = game.tree[node].stone;
+                node = game.tree[node].parent;
+                continue;
+            }
+            if (byte == CtrlByte::END_VARIATION) {
+                if (in_sequence || open.empty())
+                    return false;
+                u32 alt = open.back();
+                open.pop_back();
+                for (u32 parent = game.tree[alt].parent; node != parent;
+                     node = game.tree[node].parent)
+                    game.board.unset(game.tree[node].move().pos);
+                Move move = game.tree[alt].move();
+                game.board.set(move.pos, move.stone);
+                stone = opposite(move.stone);
+                node = alt;
+                continue;
+            }
+
+            u32 code = byte;
+            if constexpr (WIDE) {
+                if (++i == buf.size())
+                    return false;
+                code = code << 8 | buf[i];
+            }
+            Point pos(code % N, code / N);
+            if (!in_board<N>(pos) ||
+                !is_legal(game.board, pos, stone, game.variant))
+                return false;
+            game.board.set(pos, stone);
+            node = game.add_child(node, {pos, stone});
+            if (linear)
+                game.append_line(node, game.board);
+            if (!in_sequence)
+                stone = opposite(stone);
+        }
+        if (in_sequence || !open.empty())
+            return false;
+
+        if (linear) {
+            game.index = game.moves.size();
+            return true;
+        }
+        // The board is left at the end of the last variation, so the main
+        // line is built anew from the start.
+        game.board = BasicBoard<N>();
+        game.line.clear();
+        game.moves.clear();
+        game.win = nullopt;
+        game.snapshots.resize(1);
+        game.extend_line();
+        game.jump(game.moves.size());
+        return true;
+    }
+};
+
+/// A gomoku game on the standard board.
+typedef BasicGame<BOARD_SIZE> Game;
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "core.hpp"
+#include "eval.hpp"
+#include "pattern.hpp"
+
+/// A map of the scores of the candidate moves of a stone, namely the
+/// changes in the static evaluation that they make.
+///
+/// The score of a move only depends on the windows through its point,
+/// so when a stone is placed or removed, only the points on the lines
+/// through it within the reach of a window need scoring again, along
+/// with the points that have just become candidates. Scoring is done in
+/// batches by `score_pending`, so that it may be interrupted between
+/// them, and resumes where it left off after the next `sync`.
+class Heatmap {
+    Board board;
+    Stone stone = Stone::None;
+    std::array<i32, BOARD_SIZE * BOARD_SIZE> scores{};
+    BoardMask scored{};
+
+    /// Maximum number of changed points to update incrementally.
+    static const usize INCREMENTAL_LIMIT = 4;
+
+    void invalidate_around(Point p) {
+        scored[p.y] &= ~(u16(1) << p.x);
+        for (Axis axis : AXES) {
+            auto [line, bit] = line_pos(p, axis);
+            for (i32 d = -i32(PATTERN_REACH); d <= i32(PATTERN_REACH); d++) {
+                i32 b = i32(bit) + d;
+                if (d != 0 && b >= 0 &&
+                    b < i32(Geometry<BOARD_SIZE>::LINE_BITS) &&
+                    LINE_MASKS[line] >> b & 1) {
+                    Point q = line_point(axis, {line, u32(b)});
+                    scored[q.y] &= ~(u16(1) << q.x);
+                }
+            }
+        }
+    }
+
+  public:
+    /// Returns the score of a move at a point, if it is a candidate that
+    /// has been scored.
+    optional<i32> at(Point p) const {
+        if (!(scored[p.y] >> p.x & 1))
+            return nullopt;
+        return scores[p.y * BOARD_SIZE + p.x];
+    }
+
+    /// Returns the mask of the points scored.
+    const BoardMask &scored_points() const { return scored; }
+
+    /// Brings the map in sync with a board and the stone to move, marking
+    /// the scores that have changed as pending, without scoring them.
+    void sync(const Board &target, Stone target_stone) {
+        // Find the points that differ by the horizontal lines.
+        Point changed[INCREMENTAL_LIMIT];
+        usize n = 0;
+        usize offset = AXIS_LINE_OFFSETS[usize(Axis::Horizontal)];
+        for (u32 y = 0; y < BOARD_SIZE && n <= INCREMENTAL_LIMIT; y++) {
+            u16 diff = 0;
+            for (Stone s : {Stone::Black, Stone::White})
+                diff |= board.line(s, offset + y) ^ target.line(s, offset + y);
+            for (; diff != 0 && n <= INCREMENTAL_LIMIT; diff &= diff - 1) {
+                if (n < INCREMENTAL_LIMIT)
+                    changed[n] = Point(std::countr_zero(diff), y);
+                n++;
+            }
+        }
+
+        board = target;
+        if (n > INCREMENTAL_LIMIT || target_stone != stone) {
+            stone = target_stone;
+            scored = {};
+            return;
+        }
+        for (usize i = 0; i < n; i++)
+            invalidate_around(changed[i]);
+        // Forget the points that are no longer candidates.
+        BoardMask cand = board.candidates();
+        for (u32 y = 0; y < BOARD_SIZE; y++)
+            scored[y] &= cand[y];
+    }
+
+    /// Scores up to `limit` pending candidates, returning whether any is
+    /// left pending.
+    bool score_pending(usize limit) {
+        BoardMask cand = board.candidates();
+        for (u32 y = 0; y < BOARD_SIZE; y++) {
+            for (u16 row = cand[y] & ~scored[y]; row != 0; row &= row - 1) {
+                if (limit == 0)
+                    return true;
+                limit--;
+                Point p(std::countr_zero(row), y);
+                scores[y * BOARD_SIZE + p.x] = evaluate_move(board, p, stone);
+                scored[y] |= u16(1) << p.x;
+            }
+        }
+        return false;
+    }
+};
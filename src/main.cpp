@@ -1,12 +1,29 @@
 #include <QtWidgets>
 
+#include "analysis.hpp"
+#include "archive.hpp"
+#include "book.hpp"
 #include "core.hpp"
+#include "engine.hpp"
+#include "game.hpp"
+#include "heatmap.hpp"
+#include "rules.hpp"
+#include "solver.hpp"
+#include "stats.hpp"
+#include "trie.hpp"
+#include "uri.hpp"
 
 const int WINDOW_SIZE = 600;
 
 const QColor BOARD_BACKGROUND_COLOR(0xffcc66);
 
 const double TENTATIVE_MOVE_OPACITY = 0.5;
+const double HEATMAP_OPACITY = 0.5;
+/// Hue of the lowest scores on the heatmap, fading to red for the highest.
+const double HEATMAP_COLD_HUE = 2.0 / 3;
+const QColor SUGGESTION_COLOR(0x2060ff);
+const QColor BOOK_MOVE_COLOR(0x20a040);
+const QColor FOUL_COLOR(0xd02020);
 
 const double BORDER_WIDTH_RATIO = 12.0;
 const double LINE_WIDTH_RATIO = 24.0;
@@ -14,10 +31,36 @@ const double WIN_HINT_WIDTH_RATIO = 12.0;
 const double STAR_RADIUS_RATIO = 10.0;
 const double STONE_RADIUS_RATIO = 2.25;
 const double ORDINAL_FONT_SIZE_RATIOS[] = {0.65, 0.75, 0.85};
+const double FOUL_MARK_RATIO = 6.0;
 
-const Point STAR_POSITIONS[] = {{3, 3}, {3, 11}, {7, 7}, {11, 3}, {11, 11}};
+/// Minimum interval between two frames, capping the frame rate.
+const int FRAME_INTERVAL_MS = 16;
 
-const QByteArray URI_PREFIX("gomoku:");
+const milliseconds ENGINE_TIME_LIMIT(1000);
+
+/// Maximum number of moves of a principal variation shown in progress.
+const usize PROGRESS_PV_MOVES = 6;
+
+/// Name of the opening book file, next to the executable.
+const char BOOK_FILE_NAME[] = "gomoku.book";
+
+/// Name of the game database file, next to the executable, whose move
+/// trie is shown in review mode.
+const char DATABASE_FILE_NAME[] = "gomoku.db";
+
+const double TRIE_COUNT_FONT_RATIO = 0.8;
+
+/// Number of points of the heatmap scored between two checks for
+/// cancellation.
+const usize HEATMAP_BATCH = 32;
+
+/// Width of the opening explorer next to the board.
+const int EXPLORER_WIDTH = 320;
+/// Number of openings listed by the opening explorer.
+const usize EXPLORER_OPENINGS = 50;
+
+const SolveLimits VCF_LIMITS{20, 20'000};
+const SolveLimits VCT_LIMITS{6, 20'000};
 
 /// Asks the user for confirmation that the consequence is understood.
 bool confirm(QWidget *parent, const QString &consequence) {
@@ -37,16 +80,112 @@ bool confirm(QWidget *parent, const QString &consequence) {
     return ret;
 }
 
-class BoardWidget : public QWidget {
-    Game game;
+/// Returns the star points of an `N` x `N` board, namely the points
+/// three lines in from the corners, along with the center of a board of
+/// odd size, and the midpoints of its sides from 19 x 19 on.
+template <usize N> vector<Point> star_positions() {
+    const u32 a = 3, b = N - 4, c = N / 2;
+    vector<Point> stars = {{a, a}, {a, b}, {b, a}, {b, b}};
+    if (N % 2 == 1)
+        stars.push_back({c, c});
+    if (N % 2 == 1 && N >= 19)
+        stars.insert(stars.end(), {{a, c}, {c, a}, {c, b}, {b, c}});
+    return stars;
+}
+
+/// The part of a board widget that does not depend on the board size.
+class BoardWidgetBase : public QWidget {
+  public:
+    /// The action showing or hiding the opening explorer, if any, which
+    /// is added to the context menu.
+    QAction *explorer_act = nullptr;
+
+    /// Checks if we can close the widget now without user confirmation.
+    virtual bool can_close_now() = 0;
+
+    /// Replaces the game with one of the moves given, if they are legal,
+    /// asking the user for confirmation if the game is to be lost.
+    virtual void load_moves(span<const Move> moves) = 0;
+};
+
+/// The widget of an `N` x `N` board.
+///
+/// The engine, the solver, the opening book and the move trie are only
+/// available on the standard board, for which they are built, and their
+/// actions are disabled on boards of other sizes.
+template <usize N> class BoardWidget : public BoardWidgetBase {
+    /// Whether the engine, the solver, the opening book and the move
+    /// trie are available.
+    static constexpr bool ANALYSIS = N == BOARD_SIZE;
+
+    BasicGame<N> game;
     Stone stone = Stone::Black;
     optional<Point> cursor_pos;
 
-    // This is set at the very beginning of `paintEvent`, so that
-    // other event handlers may use it to convert screen position
+    Book book{QCoreApplication::applicationDirPath() + '/' + BOOK_FILE_NAME};
+    optional<MoveTrie> trie =
+        ANALYSIS ? MoveTrie::open(QCoreApplication::applicationDirPath() +
+                                  '/' + DATABASE_FILE_NAME + TRIE_SUFFIX)
+                 : nullopt;
+    Engine engine{std::thread::hardware_concurrency(), ANALYSIS ? 64u : 1u};
+    bool searching = false;
+    optional<Point> suggestion;
+
+    Solver solver;
+    optional<SolveResult> forced_win;
+
+    // The heatmap is synced and scored on the worker, which hands over
+    // a copy of it to be shown, drawn into a cached layer of its own.
+    Heatmap heatmap;
+    optional<Heatmap> shown_heatmap;
+    QPixmap heatmap_pixmap;
+    bool heatmap_pixmap_outdated = false;
+
+    // The engine, the solver and the heatmap are only used by jobs on
+    // the worker.
+    // Jobs are tagged with the generation of the position they analyse,
+    // which is bumped whenever it changes, so that results arriving for
+    // an earlier one are discarded. The generation of the running job
+    // is only touched by the worker, for its progress reports.
+    AnalysisWorker worker;
+    u64 generation = 0;
+    u64 job_generation = 0;
+    bool analysis_outdated = false;
+
+    // The points forbidden to black under renju, brought in sync with
+    // the board at the beginning of `paintEvent`.
+    BasicFoulMap<N> fouls;
+
+    // This is set by `update_cache` at the very beginning of `paintEvent`,
+    // so that other event handlers may use it to convert screen position
     // back to game position, as implemented in `to_game_pos`.
     double grid_size;
 
+    // Cached layers and metrics, rebuilt by `update_cache` only when the
+    // size or the device pixel ratio of the widget changes.
+    QPixmap board_pixmap;
+    QPixmap stone_pixmaps[2];
+    QFont ordinal_font;
+    double ordinal_font_sizes[3];
+
+    // Repaints are coalesced into frames, at most one per
+    // `FRAME_INTERVAL_MS`, which also perform the deferred updates of
+    // the analysis and the window title.
+    QTimer frame_timer;
+    QElapsedTimer frame_clock;
+    bool title_outdated = false;
+
+    // A frame repaints the whole widget if `repaints_all` is set, and
+    // otherwise only `dirty_region` and the cells that have changed with
+    // the game since the last frame, as told by the moves, the win and
+    // the stone that it drew.
+    bool repaints_all = true;
+    QRegion dirty_region;
+    vector<Move> painted_moves;
+    optional<Row> painted_win;
+    Stone painted_stone = Stone::Black;
+    bool painted_whole_position = false;
+
     /* Menu actions */
 
     QAction *pass_act;
@@ -54,22 +193,65 @@ class BoardWidget : public QWidget {
     QAction *redo_act;
     QAction *home_act;
     QAction *end_act;
+    QAction *prev_variation_act;
+    QAction *next_variation_act;
 
     QAction *review_act;
     QAction *win_hint_act;
+    QAction *forced_win_hint_act;
+    QAction *book_hint_act;
+    QAction *heatmap_act;
     QAction *ordinals_act;
     QAction *lock_stone_act;
+    QAction *scroll_frames_act;
+
+    QAction *suggest_act;
+    QAction *computer_play_act;
+    QAction *continuous_analysis_act;
 
     QAction *export_act;
+    QAction *export_tree_act;
     QAction *import_act;
 
+    QActionGroup *rule_group;
+    QAction *freestyle_act;
+    QAction *standard_act;
+    QAction *renju_act;
+
     bool reviewing() const { return review_act->isChecked(); }
     bool shows_win_hint() const { return win_hint_act->isChecked(); }
+    bool shows_forced_win_hint() const {
+        return forced_win_hint_act->isChecked();
+    }
+    bool shows_book_hint() const { return book_hint_act->isChecked(); }
+    bool shows_heatmap() const { return heatmap_act->isChecked(); }
     bool shows_ordinals() const { return ordinals_act->isChecked(); }
     bool stone_locked() const { return lock_stone_act->isChecked(); }
+    bool shows_scroll_frames() const { return scroll_frames_act->isChecked(); }
+    bool analyses_continuously() const {
+        return ANALYSIS && reviewing() && continuous_analysis_act->isChecked();
+    }
+    bool shows_tentative_fouls() const {
+        return !reviewing() && stone == Stone::Black &&
+               game.rule() == Rule::Renju;
+    }
 
   public:
     BoardWidget() {
+        engine.set_book(&book);
+        engine.set_progress_handler([this](const SearchResult &res) {
+            QMetaObject::invokeMethod(
+                this,
+                [this, res, gen = job_generation] {
+                    if (gen == generation)
+                        search_progressed(res);
+                },
+                Qt::QueuedConnection);
+        });
+
+        frame_timer.setSingleShot(true);
+        connect(&frame_timer, &QTimer::timeout, this, &BoardWidget::draw_frame);
+
         pass_act = new QAction("让子", this);
         pass_act->setShortcut(Qt::CTRL | Qt::Key_P);
         undo_act = new QAction("悔棋", this);
@@ -82,64 +264,161 @@ class BoardWidget : public QWidget {
         end_act = new QAction("跳转至局末", this);
         end_act->setShortcut(Qt::Key_End);
         end_act->setAutoRepeat(false);
+        prev_variation_act = new QAction("上一变化", this);
+        prev_variation_act->setShortcut(Qt::Key_PageUp);
+        next_variation_act = new QAction("下一变化", this);
+        next_variation_act->setShortcut(Qt::Key_PageDown);
 
         review_act = new QAction("复盘模式", this);
         review_act->setCheckable(true);
         win_hint_act = new QAction("胜利提示", this);
         win_hint_act->setCheckable(true);
+        forced_win_hint_act = new QAction("必胜提示", this);
+        forced_win_hint_act->setCheckable(true);
+        book_hint_act = new QAction("开局库提示", this);
+        book_hint_act->setCheckable(true);
+        heatmap_act = new QAction("热力图", this);
+        heatmap_act->setCheckable(true);
         ordinals_act = new QAction("序号显示", this);
         ordinals_act->setCheckable(true);
         lock_stone_act = new QAction("锁定棋子", this);
         lock_stone_act->setCheckable(true);
+        scroll_frames_act = new QAction("滚动时显示中间局面", this);
+        scroll_frames_act->setCheckable(true);
+        scroll_frames_act->setChecked(true);
+
+        suggest_act = new QAction("提示", this);
+        suggest_act->setShortcut(Qt::CTRL | Qt::Key_T);
+        suggest_act->setAutoRepeat(false);
+        computer_play_act = new QAction("电脑落子", this);
+        computer_play_act->setShortcut(Qt::CTRL | Qt::Key_G);
+        computer_play_act->setAutoRepeat(false);
+        continuous_analysis_act = new QAction("复盘时持续分析", this);
+        continuous_analysis_act->setCheckable(true);
 
         export_act = new QAction("导出至剪贴板", this);
         export_act->setShortcut(Qt::CTRL | Qt::Key_C);
         export_act->setAutoRepeat(false);
+        export_tree_act = new QAction("导出全部变化至剪贴板", this);
+        export_tree_act->setShortcut(Qt::CTRL | Qt::SHIFT | Qt::Key_C);
+        export_tree_act->setAutoRepeat(false);
         import_act = new QAction("自剪贴板导入", this);
         import_act->setShortcut(Qt::CTRL | Qt::Key_V);
         import_act->setAutoRepeat(false);
 
+        rule_group = new QActionGroup(this);
+        freestyle_act = rule_group->addAction("无禁手");
+        standard_act = rule_group->addAction("标准（恰好五子）");
+        renju_act = rule_group->addAction("连珠（黑方禁手）");
+        for (QAction *act : rule_group->actions())
+            act->setCheckable(true);
+        freestyle_act->setChecked(true);
+
+        for (QAction *act : {forced_win_hint_act, book_hint_act, heatmap_act,
+                             suggest_act, computer_play_act,
+                             continuous_analysis_act})
+            act->setEnabled(ANALYSIS);
+
         connect(pass_act, &QAction::triggered, this, &BoardWidget::pass);
         connect(undo_act, &QAction::triggered, this, &BoardWidget::undo);
         connect(redo_act, &QAction::triggered, this, &BoardWidget::redo);
         connect(home_act, &QAction::triggered, this, &BoardWidget::home);
         connect(end_act, &QAction::triggered, this, &BoardWidget::end);
+        connect(prev_variation_act, &QAction::triggered, this,
+                [this] { switch_variation(false); });
+        connect(next_variation_act, &QAction::triggered, this,
+                [this] { switch_variation(true); });
 
         connect(review_act, &QAction::toggled, this,
                 &BoardWidget::toggle_review);
         connect(win_hint_act, &QAction::toggled, this,
                 &BoardWidget::toggle_win_hint);
+        connect(forced_win_hint_act, &QAction::toggled, this,
+                &BoardWidget::toggle_forced_win_hint);
+        connect(book_hint_act, &QAction::toggled, this,
+                &BoardWidget::toggle_book_hint);
+        connect(heatmap_act, &QAction::toggled, this,
+                &BoardWidget::toggle_heatmap);
         connect(ordinals_act, &QAction::toggled, this,
                 &BoardWidget::toggle_ordinals);
 
+        connect(suggest_act, &QAction::triggered, this,
+                &BoardWidget::suggest);
+        connect(computer_play_act, &QAction::triggered, this,
+                &BoardWidget::computer_play);
+        connect(continuous_analysis_act, &QAction::toggled, this,
+                &BoardWidget::toggle_continuous_analysis);
+
         connect(export_act, &QAction::triggered, this,
                 &BoardWidget::export_game);
+        connect(export_tree_act, &QAction::triggered, this,
+                &BoardWidget::export_tree);
         connect(import_act, &QAction::triggered, this,
                 &BoardWidget::import_game);
 
+        connect(rule_group, &QActionGroup::triggered, this,
+                &BoardWidget::change_rule);
+
         // This is required for the shortcuts to work.
-        addActions({pass_act, undo_act, redo_act, home_act, end_act, export_act,
+        addActions({pass_act, undo_act, redo_act, home_act, end_act,
+                    prev_variation_act, next_variation_act, suggest_act,
+                    computer_play_act, export_act, export_tree_act,
                     import_act});
     }
 
-    ~BoardWidget() {
+    ~BoardWidget() override {
+        // The jobs on the worker use the engine and the solver, so the
+        // worker must finish first.
+        worker.stop();
+
         delete pass_act;
         delete undo_act;
         delete redo_act;
         delete home_act;
         delete end_act;
+        delete prev_variation_act;
+        delete next_variation_act;
 
         delete review_act;
         delete win_hint_act;
+        delete forced_win_hint_act;
+        delete book_hint_act;
+        delete heatmap_act;
         delete ordinals_act;
         delete lock_stone_act;
+        delete scroll_frames_act;
+
+        delete suggest_act;
+        delete computer_play_act;
+        delete continuous_analysis_act;
 
         delete export_act;
+        delete export_tree_act;
         delete import_act;
+
+        delete freestyle_act;
+        delete standard_act;
+        delete renju_act;
+        delete rule_group;
     }
 
     /// Checks if we can close the widget now without user confirmation.
-    bool can_close_now() { return game.total_moves() == 0; }
+    bool can_close_now() override { return game.total_moves() == 0; }
+
+    void load_moves(span<const Move> moves) override {
+        BasicGame<N> res(game.rule());
+        for (Move move : moves)
+            if (!res.make_move(move.pos, move.stone))
+                return;
+
+        if (game.total_moves() != 0 &&
+            !confirm(this, QString("载入 %1 手棋并完全覆盖当前对局")
+                               .arg(moves.size()))) {
+            return;
+        }
+        game = std::move(res);
+        game_updated();
+    }
 
     /* Helper methods */
   private:
@@ -148,7 +427,7 @@ class BoardWidget : public QWidget {
         double x = pos.x() / grid_size - 0.5;
         double y = pos.y() / grid_size - 0.5;
 
-        if (x < 0 || x >= BOARD_SIZE || y < 0 || y >= BOARD_SIZE)
+        if (x < 0 || x >= N || y < 0 || y >= N)
             return nullopt;
         return Point(x, y);
     }
@@ -158,6 +437,130 @@ class BoardWidget : public QWidget {
         return {(pos.x + 1) * grid_size, (pos.y + 1) * grid_size};
     }
 
+    /// Returns the screen rectangle of the cell around a game position,
+    /// which contains everything drawn for the position.
+    QRect cell_rect(Point pos) const {
+        QPointF center = to_screen_pos(pos);
+        double half = grid_size / 2;
+        return QRectF(center.x() - half, center.y() - half, grid_size,
+                      grid_size)
+            .toAlignedRect()
+            .adjusted(-1, -1, 1, 1);
+    }
+
+    /// Rebuilds the cached layers and metrics if the size or the device
+    /// pixel ratio of the widget has changed.
+    void update_cache() {
+        qreal dpr = devicePixelRatioF();
+        QSize pixel_size = size() * dpr;
+        if (board_pixmap.size() == pixel_size &&
+            board_pixmap.devicePixelRatio() == dpr)
+            return;
+
+        int w = width();
+        grid_size = double(w) / (N + 1);
+        heatmap_pixmap_outdated = true;
+
+        // Draw the board background, the lines, the border and the stars.
+        board_pixmap = QPixmap(pixel_size);
+        board_pixmap.setDevicePixelRatio(dpr);
+        board_pixmap.fill(BOARD_BACKGROUND_COLOR);
+        QPainter p(&board_pixmap);
+        p.setRenderHint(QPainter::Antialiasing, true);
+
+        double border_width = grid_size / BORDER_WIDTH_RATIO;
+        double line_width = grid_size / LINE_WIDTH_RATIO;
+
+        for (int i = 1; i <= int(N); i++) {
+            double pos = grid_size * i;
+
+            if (i == 1 || i == int(N))
+                p.setPen(QPen(Qt::black, border_width));
+            else
+                p.setPen(QPen(Qt::black, line_width));
+
+            p.drawLine(QPointF(grid_size, pos), QPointF(w - grid_size, pos));
+            p.drawLine(QPointF(pos, grid_size), QPointF(pos, w - grid_size));
+        }
+
+        p.setPen(Qt::NoPen);
+        p.setBrush(Qt::black);
+        double star_radius = grid_size / STAR_RADIUS_RATIO;
+        for (Point pos : star_positions<N>()) {
+            draw_circle(p, pos, star_radius);
+        }
+        p.end();
+
+        // Draw the stone sprites, centered in pixmaps of a cell's size.
+        double stone_radius = grid_size / STONE_RADIUS_RATIO;
+        int cell = std::ceil(grid_size * dpr);
+        for (int i = 0; i < 2; i++) {
+            QPixmap &sprite = stone_pixmaps[i];
+            sprite = QPixmap(cell, cell);
+            sprite.setDevicePixelRatio(dpr);
+            sprite.fill(Qt::transparent);
+            QPainter sp(&sprite);
+            sp.setRenderHint(QPainter::Antialiasing, true);
+            sp.setPen(Qt::NoPen);
+            sp.setBrush(i == 0 ? Qt::black : Qt::white);
+            double center = cell / dpr / 2;
+            sp.drawEllipse(QPointF(center, center), stone_radius,
+                           stone_radius);
+        }
+
+        // Calculate the ordinal font sizes.
+        ordinal_font = QFont("Arial", 64);
+        ordinal_font.setBold(true);
+        QFontMetrics fm(ordinal_font);
+        QRect rects[3] = {fm.tightBoundingRect("0"),
+                          fm.tightBoundingRect("00"),
+                          fm.tightBoundingRect("000")};
+        double stone_diameter = stone_radius * 2.0;
+        for (int i = 0; i < 3; i++) {
+            int text_diameter = std::max(rects[i].width(), rects[i].height());
+            double ratio =
+                stone_diameter / text_diameter * ORDINAL_FONT_SIZE_RATIOS[i];
+            ordinal_font_sizes[i] = 64.0 * ratio;
+        }
+    }
+
+    /// Redraws the heatmap layer, coloring each point scored by its score
+    /// relative to the highest, on a log scale, as the scores of windows
+    /// grow geometrically.
+    void update_heatmap_pixmap() {
+        heatmap_pixmap_outdated = false;
+        heatmap_pixmap = QPixmap(board_pixmap.size());
+        heatmap_pixmap.setDevicePixelRatio(board_pixmap.devicePixelRatio());
+        heatmap_pixmap.fill(Qt::transparent);
+
+        const BoardMask &points = shown_heatmap->scored_points();
+        i32 max = 0;
+        for_each_point(points, [&](Point pos) {
+            max = std::max(max, *shown_heatmap->at(pos));
+        });
+
+        QPainter p(&heatmap_pixmap);
+        p.setRenderHint(QPainter::Antialiasing, true);
+        p.setPen(Qt::NoPen);
+        double stone_radius = grid_size / STONE_RADIUS_RATIO;
+        for_each_point(points, [&](Point pos) {
+            i32 score = *shown_heatmap->at(pos);
+            double t = max > 0 ? std::log1p(score) / std::log1p(max) : 0;
+            p.setBrush(QColor::fromHsvF((1 - t) * HEATMAP_COLD_HUE, 1, 1));
+            draw_circle(p, pos, stone_radius);
+        });
+    }
+
+    /// Draws the sprite of a stone other than `None` at a game position.
+    void draw_stone(QPainter &p, Point pos, Stone stone) const {
+        const QPixmap &sprite = stone_pixmaps[stone == Stone::Black ? 0 : 1];
+        QPointF center = to_screen_pos(pos);
+        QSizeF half = sprite.deviceIndependentSize() / 2;
+        p.drawPixmap(QPointF(center.x() - half.width(),
+                             center.y() - half.height()),
+                     sprite);
+    }
+
     /// Draws a circle at a game position with the given radius.
     void draw_circle(QPainter &p, Point pos, double radius) const {
         p.drawEllipse(to_screen_pos(pos), radius, radius);
@@ -171,18 +574,241 @@ class BoardWidget : public QWidget {
         return p;
     }
 
+    /// Posts a job of analysis of the current position to the worker,
+    /// handing its result to `done` on this thread, unless the position
+    /// has changed by then.
+    template <class Work, class Done> void post_job(Work work, Done done) {
+        worker.post([this, gen = generation, work = std::move(work),
+                     done = std::move(done)](const std::atomic<bool> &cancel) {
+            job_generation = gen;
+            auto res = work(cancel);
+            QMetaObject::invokeMethod(
+                this,
+                [this, gen, done, res = std::move(res)] {
+                    if (gen == generation)
+                        done(res);
+                },
+                Qt::QueuedConnection);
+        });
+    }
+
+    /// Cancels the analysis of the previous position, whose results are
+    /// discarded from now on, and schedules that of the current one in
+    /// the next frame.
+    void invalidate_analysis() {
+        generation++;
+        worker.cancel_all();
+        analysis_outdated = true;
+        if (searching) {
+            searching = false;
+            suggest_act->setEnabled(true);
+            computer_play_act->setEnabled(true);
+        }
+    }
+
+    /// Restarts the analysis of the current position at once.
+    void restart_analysis() {
+        invalidate_analysis();
+        start_analysis();
+    }
+
+    /// Posts the jobs of analysis of the current position, namely the
+    /// forced win, provided that its hint is shown and that no win is
+    /// witnessed yet, and the continuous analysis, if enabled.
+    void start_analysis() {
+        analysis_outdated = false;
+        if constexpr (ANALYSIS) {
+            if (shows_forced_win_hint() && !game.first_win()) {
+                post_job(
+                    [this, position = game.position(), turn = game.infer_turn(),
+                     rule = game.rule()](const std::atomic<bool> &cancel) {
+                        SolveLimits vcf = VCF_LIMITS, vct = VCT_LIMITS;
+                        vcf.cancel = vct.cancel = &cancel;
+                        SolveResult res = solver.solve(
+                            position, turn, SolveMode::Vcf, vcf, rule);
+                        if (!res.win)
+                            res = solver.solve(position, turn, SolveMode::Vct,
+                                               vct, rule);
+                        return res;
+                    },
+                    [this](const SolveResult &res) {
+                        if (!res.win)
+                            return;
+                        forced_win = res;
+                        request_repaint();
+                    });
+            }
+
+            if (shows_heatmap()) {
+                post_job(
+                    [this, position = game.position(),
+                     stone = stone](const std::atomic<bool> &cancel) {
+                        heatmap.sync(position, stone);
+                        while (!cancel && heatmap.score_pending(HEATMAP_BATCH))
+                            ;
+                        return heatmap;
+                    },
+                    [this](const Heatmap &map) {
+                        shown_heatmap = map;
+                        heatmap_pixmap_outdated = true;
+                        request_repaint();
+                    });
+            }
+
+            // This runs until cancelled, so it must be posted last.
+            if (analyses_continuously() && !game.first_win()) {
+                post_job(
+                    [this, snapshot = game,
+                     stone = stone](const std::atomic<bool> &cancel) {
+                        SearchLimits limits;
+                        limits.time = milliseconds(0);
+                        limits.cancel = &cancel;
+                        return engine.search(snapshot, stone, limits);
+                    },
+                    [this](const SearchResult &res) {
+                        search_progressed(res);
+                    });
+            }
+        }
+    }
+
+    /// Schedules a repaint of the whole widget in the next frame, as in
+    /// `schedule_frame`.
+    void request_repaint(bool debounce = false) {
+        repaints_all = true;
+        schedule_frame(debounce);
+    }
+
+    /// Schedules a frame.
+    ///
+    /// Frames are drawn at most once per `FRAME_INTERVAL_MS`, so that
+    /// bursts of requests are coalesced into one frame. If `debounce` is
+    /// set, the frame is instead postponed until no request has been made
+    /// for a whole interval, so that only the final state is drawn.
+    void schedule_frame(bool debounce = false) {
+        if (debounce) {
+            frame_timer.start(FRAME_INTERVAL_MS);
+            return;
+        }
+        if (frame_timer.isActive())
+            return;
+        qint64 elapsed =
+            frame_clock.isValid() ? frame_clock.elapsed() : FRAME_INTERVAL_MS;
+        frame_timer.start(std::max<qint64>(FRAME_INTERVAL_MS - elapsed, 0));
+    }
+
+    /// Checks if anything drawn depends on the position as a whole,
+    /// namely the counts of games in the database, the book move or the
+    /// points forbidden to the tentative move, so that a frame after any
+    /// change of the position must repaint the whole widget.
+    bool draws_whole_position() const {
+        return (reviewing() && trie) || shows_book_hint() ||
+               shows_tentative_fouls();
+    }
+
+    /// Returns the region of the cells that have changed with the game
+    /// since the last frame, along with `dirty_region`.
+    ///
+    /// As the ordinals go with the moves, the moves past the common
+    /// prefix of the moves drawn and the current ones are repainted, both
+    /// old and new, along with the old and the new last moves, which bear
+    /// the marker. So are the old and the new win rows if they differ,
+    /// and the tentative move if the stone to play has changed.
+    QRegion changed_region() const {
+        QRegion region = dirty_region;
+        auto moves = game.past_moves();
+        usize common = 0;
+        while (common < moves.size() && common < painted_moves.size() &&
+               moves[common] == painted_moves[common])
+            common++;
+        for (usize i = common; i < painted_moves.size(); i++)
+            region += cell_rect(painted_moves[i].pos);
+        for (usize i = common; i < moves.size(); i++)
+            region += cell_rect(moves[i].pos);
+        if (common != moves.size() || common != painted_moves.size()) {
+            // The last move marker may move within the common prefix.
+            if (!moves.empty())
+                region += cell_rect(moves.back().pos);
+            if (!painted_moves.empty())
+                region += cell_rect(painted_moves.back().pos);
+        }
+
+        auto win = game.first_win();
+        optional<Row> row = win ? optional<Row>(win->row) : nullopt;
+        bool same_win = row.has_value() == painted_win.has_value() &&
+                        (!row || (row->start == painted_win->start &&
+                                  row->end == painted_win->end));
+        if (!same_win) {
+            for (const optional<Row> &r : {row, painted_win}) {
+                if (r)
+                    region += cell_rect(r->start).united(cell_rect(r->end));
+            }
+        }
+
+        if (stone != painted_stone && cursor_pos)
+            region += cell_rect(*cursor_pos);
+        return region;
+    }
+
+    /// Performs the deferred updates and repaints what has changed.
+    void draw_frame() {
+        if (analysis_outdated)
+            start_analysis();
+        if (title_outdated) {
+            update_title();
+            title_outdated = false;
+        }
+
+        bool whole_position = draws_whole_position();
+        if (repaints_all || whole_position || painted_whole_position) {
+            update();
+        } else if (QRegion region = changed_region(); !region.isEmpty()) {
+            update(region);
+        }
+
+        auto moves = game.past_moves();
+        painted_moves.assign(moves.begin(), moves.end());
+        auto win = game.first_win();
+        painted_win = win ? optional<Row>(win->row) : nullopt;
+        painted_stone = stone;
+        painted_whole_position = whole_position;
+        repaints_all = false;
+        dirty_region = QRegion();
+    }
+
     /// Called when the moves in the game are updated.
     ///
     /// Performs the following actions:
     ///
     /// - Updates the current stone as inferred from the game,
     ///   provided that the stone is not locked.
-    /// - Updates the window title.
-    /// - Repaints the widget.
-    void game_updated() {
+    /// - Clears the suggested move and the forced win, and cancels the
+    ///   analysis of the previous position.
+    /// - Schedules a frame, which starts the analysis of the current
+    ///   position, updates the window title, and repaints the cells that
+    ///   have changed, as found by `changed_region`, including those of
+    ///   the suggested move and the forced win cleared. If `debounce` is
+    ///   set, the frame is postponed as in `schedule_frame`.
+    void game_updated(bool debounce = false) {
         if (!stone_locked())
             stone = game.infer_turn();
+        if (suggestion)
+            dirty_region += cell_rect(*suggestion);
+        if (forced_win) {
+            const vector<Point> &line = forced_win->line;
+            for (usize i = 0; i < line.size(); i += 2)
+                dirty_region += cell_rect(line[i]);
+        }
+        suggestion = nullopt;
+        forced_win = nullopt;
+        invalidate_analysis();
+        title_outdated = true;
+        schedule_frame(debounce);
+    }
 
+    /// Updates the window title with the move index, and with the
+    /// variation of the next move if there are several.
+    void update_title() {
         usize index = game.move_index(), total = game.total_moves();
         QString index_str =
             index == 0 ? QString("开局") : QString("第 %1 手").arg(index);
@@ -192,66 +818,109 @@ class BoardWidget : public QWidget {
         } else {
             title = QString("五子棋 (%1 / 共 %2 手)").arg(index_str).arg(total);
         }
+        if (usize count = game.variation_count(); count > 1) {
+            title += QString(" - 变化 %1 / %2")
+                         .arg(game.variation_index() + 1)
+                         .arg(count);
+        }
         ((QMainWindow *)parent())->setWindowTitle(title);
+    }
 
-        repaint();
+    /// Called on this thread with the progress of a search of the current
+    /// position, showing it, along with the best move so far if the
+    /// analysis is continuous.
+    void search_progressed(const SearchResult &res) {
+        show_progress(res);
+        if (analyses_continuously() && res.best && suggestion != res.best) {
+            suggestion = res.best;
+            request_repaint();
+        }
+    }
+
+    /// Shows the progress of a search in the status bar, namely the
+    /// depth, the nodes and their rate, the statistics if counted, the
+    /// time of the last iteration and the principal variation.
+    void show_progress(const SearchResult &res) {
+        double secs = res.elapsed.count() / 1000.0;
+        double knps = secs > 0 ? res.nodes / secs / 1000 : 0;
+        QString text = QString("深度 %1 · %2 节点 · %3 千节点/秒")
+                           .arg(res.depth)
+                           .arg(res.nodes)
+                           .arg(knps, 0, 'f', 0);
+        if (STATS_ENABLED) {
+            const SearchStats &stats = res.stats;
+            text += QString(" · 置换表命中 %1% · 首着剪枝 %2%")
+                        .arg(stats.ratio(Stat::TtHits, Stat::TtProbes) * 100,
+                             0, 'f', 1)
+                        .arg(stats.ratio(Stat::FirstMoveCutoffs,
+                                         Stat::Cutoffs) *
+                                 100,
+                             0, 'f', 1);
+        }
+        if (!res.depth_times.empty())
+            text += QString(" · 末层 %1 毫秒").arg(res.depth_times.back().count());
+        if (!res.pv.empty()) {
+            text += " ·";
+            usize n = std::min(res.pv.size(), PROGRESS_PV_MOVES);
+            for (usize i = 0; i < n; i++)
+                text += QString(" (%1,%2)").arg(res.pv[i].x).arg(res.pv[i].y);
+            if (n < res.pv.size())
+                text += " …";
+        }
+        ((QMainWindow *)parent())->statusBar()->showMessage(text);
     }
 
     /* Event handlers */
   protected:
     void contextMenuEvent(QContextMenuEvent *event) override {
         QMenu menu(this);
-        menu.addActions({pass_act, undo_act, redo_act, home_act, end_act});
+        menu.addActions({pass_act, undo_act, redo_act, home_act, end_act,
+                         prev_variation_act, next_variation_act});
+        menu.addSeparator();
+        menu.addActions(
+            {review_act, win_hint_act, forced_win_hint_act, book_hint_act,
+             heatmap_act, ordinals_act, lock_stone_act, scroll_frames_act});
         menu.addSeparator();
         menu.addActions(
-            {review_act, win_hint_act, ordinals_act, lock_stone_act});
+            {suggest_act, computer_play_act, continuous_analysis_act});
+        menu.addSeparator();
+        menu.addActions({export_act, export_tree_act, import_act});
+        if (explorer_act)
+            menu.addAction(explorer_act);
         menu.addSeparator();
-        menu.addActions({export_act, import_act});
+        QMenu *rule_menu = menu.addMenu("规则");
+        rule_menu->addActions(rule_group->actions());
         menu.exec(event->globalPos());
     }
 
-    void paintEvent(QPaintEvent *) override {
+    void paintEvent(QPaintEvent *event) override {
+        frame_clock.restart();
+        update_cache();
+
         QPainter p(this);
         p.setRenderHint(QPainter::Antialiasing, true);
 
-        // Draw the board background.
-        p.setPen(Qt::NoPen);
-        p.setBrush(BOARD_BACKGROUND_COLOR);
-        p.drawRect(rect());
-
-        // Draw the lines and the border.
-        int w = width();
-        grid_size = double(w) / (BOARD_SIZE + 1);
-
-        double border_width = grid_size / BORDER_WIDTH_RATIO;
-        double line_width = grid_size / LINE_WIDTH_RATIO;
-
-        for (int i = 1; i <= BOARD_SIZE; i++) {
-            double pos = grid_size * i;
-
-            if (i == 1 || i == BOARD_SIZE)
-                p.setPen(QPen(Qt::black, border_width));
-            else
-                p.setPen(QPen(Qt::black, line_width));
-
-            p.drawLine(QPointF(grid_size, pos), QPointF(w - grid_size, pos));
-            p.drawLine(QPointF(pos, grid_size), QPointF(pos, w - grid_size));
+        // Draw the cached board background, lines, border and stars.
+        p.drawPixmap(0, 0, board_pixmap);
+
+        // Draw the cached heatmap beneath the stones, which cover the
+        // points of a heatmap shown until that of their position is done.
+        if (shown_heatmap) {
+            if (heatmap_pixmap_outdated)
+                update_heatmap_pixmap();
+            p.setOpacity(HEATMAP_OPACITY);
+            p.drawPixmap(0, 0, heatmap_pixmap);
+            p.setOpacity(1);
         }
 
-        // Draw the stars.
-        p.setPen(Qt::NoPen);
-        p.setBrush(Qt::black);
+        // Draw the stones, skipping those outside the repainted area.
+        QRect dirty = event->rect();
         double star_radius = grid_size / STAR_RADIUS_RATIO;
-        for (Point pos : STAR_POSITIONS) {
-            draw_circle(p, pos, star_radius);
-        }
-
-        // Draw the stones.
         double stone_radius = grid_size / STONE_RADIUS_RATIO;
         auto moves = game.past_moves();
         for (auto [pos, val] : moves) {
-            p.setBrush(val == Stone::Black ? Qt::black : Qt::white);
-            draw_circle(p, pos, stone_radius);
+            if (dirty.intersects(cell_rect(pos)))
+                draw_stone(p, pos, val);
         }
 
         // Draw the win hint.
@@ -264,35 +933,33 @@ class BoardWidget : public QWidget {
             p.drawLine(to_screen_pos(start), to_screen_pos(end));
         }
 
+        // Draw the forced win hint, marking the attacking moves.
+        if (forced_win) {
+            double win_hint_width = grid_size / WIN_HINT_WIDTH_RATIO;
+            p.setPen(QPen(Qt::red, win_hint_width, Qt::DotLine));
+            p.setBrush(Qt::NoBrush);
+
+            const vector<Point> &line = forced_win->line;
+            for (usize i = 0; i < line.size(); i += 2)
+                draw_circle(p, line[i], stone_radius);
+        }
+
         if (shows_ordinals()) {
             // Draw the ordinals.
-            QFont font("Arial", 64);
-            font.setBold(true);
-            QFontMetrics fm(font);
-
-            // Calculate font sizes.
-            QRect rects[3] = {fm.tightBoundingRect("0"),
-                              fm.tightBoundingRect("00"),
-                              fm.tightBoundingRect("000")};
-            double font_sizes[3];
+            QFont font = ordinal_font;
             double stone_diameter = stone_radius * 2.0;
-            for (int i = 0; i < 3; i++) {
-                int text_diameter =
-                    std::max(rects[i].width(), rects[i].height());
-                double ratio = stone_diameter / text_diameter *
-                               ORDINAL_FONT_SIZE_RATIOS[i];
-                font_sizes[i] = 64.0 * ratio;
-            }
 
             for (usize i = 0; i < moves.size(); i++) {
                 auto [pos, val] = moves[i];
+                if (!dirty.intersects(cell_rect(pos)))
+                    continue;
                 QPointF screen_pos = to_screen_pos(pos);
                 QRectF stone_rect(screen_pos.x() - stone_radius,
                                   screen_pos.y() - stone_radius, stone_diameter,
                                   stone_diameter);
 
                 QString ordinal = QString::number(i + 1);
-                font.setPointSizeF(font_sizes[ordinal.size() - 1]);
+                font.setPointSizeF(ordinal_font_sizes[ordinal.size() - 1]);
 
                 p.setPen(val == Stone::Black ? Qt::white : Qt::black);
                 p.setFont(font);
@@ -306,24 +973,89 @@ class BoardWidget : public QWidget {
             draw_circle(p, pos, star_radius);
         }
 
-        // Draw the tentative move.
-        p.setPen(Qt::NoPen);
-        if (!reviewing() && filter_unoccupied(cursor_pos)) {
-            p.setBrush(stone == Stone::Black ? Qt::black : Qt::white);
+        // Draw the suggested move.
+        if (suggestion) {
+            double suggestion_width = grid_size / WIN_HINT_WIDTH_RATIO;
+            p.setPen(QPen(SUGGESTION_COLOR, suggestion_width, Qt::DotLine));
+            p.setBrush(Qt::NoBrush);
+            draw_circle(p, *suggestion, stone_radius);
+        }
+
+        // Draw the numbers of games in the database continuing with each
+        // move from the current position.
+        if (reviewing() && trie) {
+            if (auto node = trie->find(game.past_moves())) {
+                QFont font("Arial");
+                font.setPixelSize(std::max(
+                    1, int(stone_radius * TRIE_COUNT_FONT_RATIO)));
+                p.setFont(font);
+                trie->for_each_child(*node, [&](Move move, u32 games) {
+                    if (game.stone_at(move.pos) != Stone::None)
+                        return;
+                    p.setPen(move.stone == Stone::Black ? Qt::black
+                                                        : Qt::white);
+                    QPointF center = to_screen_pos(move.pos);
+                    QRectF rect(center.x() - stone_radius,
+                                center.y() - stone_radius, stone_radius * 2,
+                                stone_radius * 2);
+                    p.drawText(rect, Qt::AlignCenter, QString::number(games));
+                });
+            }
+        }
+
+        // Draw the book move.
+        if constexpr (ANALYSIS) {
+            auto entry = shows_book_hint() ? book.probe(game.position(), stone)
+                                           : nullopt;
+            if (entry) {
+                double book_move_width = grid_size / WIN_HINT_WIDTH_RATIO;
+                p.setPen(QPen(BOOK_MOVE_COLOR, book_move_width, Qt::DotLine));
+                p.setBrush(Qt::NoBrush);
+                draw_circle(p, entry->move, stone_radius);
+            }
+        }
+
+        // Draw the tentative move, with crosses on the points forbidden
+        // to it, where it is not drawn.
+        bool shows_fouls = shows_tentative_fouls();
+        if (shows_fouls) {
+            fouls.sync(game.position());
+            double half = grid_size / FOUL_MARK_RATIO;
+            p.setPen(QPen(FOUL_COLOR, grid_size / WIN_HINT_WIDTH_RATIO));
+            for (u32 y = 0; y < N; y++) {
+                for (u32 x = 0; x < N; x++) {
+                    Point pos(x, y);
+                    if (fouls.at(pos) == Foul::None ||
+                        !dirty.intersects(cell_rect(pos)))
+                        continue;
+                    QPointF c = to_screen_pos(pos);
+                    p.drawLine(c + QPointF(-half, -half),
+                               c + QPointF(half, half));
+                    p.drawLine(c + QPointF(-half, half),
+                               c + QPointF(half, -half));
+                }
+            }
+        }
+        if (!reviewing() && filter_unoccupied(cursor_pos) &&
+            !(shows_fouls && fouls.at(*cursor_pos) != Foul::None)) {
             p.setOpacity(TENTATIVE_MOVE_OPACITY);
-            draw_circle(p, *cursor_pos, stone_radius);
+            draw_stone(p, *cursor_pos, stone);
         }
     }
 
     void hoverEvent(QSinglePointEvent *event) {
         auto pos = to_game_pos(event->position());
-        // Repaint iff the tentative move should disappear,
-        // or should appear at or proceed to an unoccupied position.
-        bool should_repaint =
-            filter_unoccupied(pos) != filter_unoccupied(cursor_pos);
+        // Repaint the cells that the tentative move should disappear from
+        // or appear at, if any.
+        auto old_move = filter_unoccupied(cursor_pos);
+        auto new_move = filter_unoccupied(pos);
         cursor_pos = pos;
-        if (!reviewing() && should_repaint)
-            repaint();
+        if (reviewing() || old_move == new_move)
+            return;
+        if (old_move)
+            update(cell_rect(*old_move));
+        if (new_move)
+            update(cell_rect(*new_move));
     }
 
     void enterEvent(QEnterEvent *event) override { hoverEvent(event); }
@@ -336,10 +1068,8 @@ class BoardWidget : public QWidget {
         if (!p)
             return;
 
-        auto future = game.future_moves();
-        if (!future.empty() &&
-            !confirm(this, QString("覆盖未来的 %1 手棋").arg(future.size())))
-            return;
+        // A move off the current line starts a new variation, keeping
+        // the old future as another, so nothing is lost.
         if (!game.make_move(*p, stone))
             return;
 
@@ -351,16 +1081,24 @@ class BoardWidget : public QWidget {
             return;
         bool forward = event->angleDelta().y() > 0;
         if (forward ? game.redo() : game.undo())
-            game_updated();
+            game_updated(!shows_scroll_frames());
     }
 
     /* Menu slots */
   private:
     void pass() {
         stone = opposite(stone);
-        // Repaint iff the tentative move has appeared.
-        if (!reviewing() && filter_unoccupied(cursor_pos))
-            repaint();
+        // Repaint iff the suggested move, which was searched for the other
+        // stone, should disappear, the book move may have changed, or the
+        // tentative move or the forbidden points have appeared.
+        bool should_repaint = suggestion || shows_book_hint() ||
+                              (!reviewing() && filter_unoccupied(cursor_pos)) ||
+                              (!reviewing() && game.rule() == Rule::Renju);
+        suggestion = nullopt;
+        // Searches are for the current stone, so they must start over.
+        restart_analysis();
+        if (should_repaint)
+            request_repaint();
     }
 
     void undo() {
@@ -383,67 +1121,189 @@ class BoardWidget : public QWidget {
             game_updated();
     }
 
+    /// Switches to the previous or the next variation of the next move,
+    /// wrapping around.
+    void switch_variation(bool forward) {
+        usize count = game.variation_count();
+        if (count < 2)
+            return;
+        usize i = game.variation_index();
+        if (game.select_variation((i + (forward ? 1 : count - 1)) % count))
+            game_updated();
+    }
+
     void toggle_review(bool enabled) {
-        // Repaint iff the tentative move should appear or disappear.
-        if (filter_unoccupied(cursor_pos))
-            repaint();
+        // The continuous analysis only runs in review mode.
+        if (continuous_analysis_act->isChecked())
+            toggle_continuous_analysis(enabled);
+        // Repaint iff the tentative move, the forbidden points or the game
+        // counts should appear or disappear.
+        if (filter_unoccupied(cursor_pos) || trie ||
+            game.rule() == Rule::Renju)
+            request_repaint();
     }
 
     void toggle_win_hint(bool enabled) {
         // Repaint iff the win hint should appear or disappear.
         if (game.first_win())
-            repaint();
+            request_repaint();
+    }
+
+    void toggle_forced_win_hint(bool enabled) {
+        // The forced win, if any, is repainted once solved.
+        bool had_forced_win = forced_win.has_value();
+        forced_win = nullopt;
+        restart_analysis();
+        // Repaint iff the forced win hint should disappear.
+        if (had_forced_win)
+            request_repaint();
+    }
+
+    void toggle_continuous_analysis(bool enabled) {
+        // Repaint iff the suggested move of the analysis should disappear.
+        if (!analyses_continuously() && suggestion) {
+            suggestion = nullopt;
+            request_repaint();
+        }
+        restart_analysis();
+    }
+
+    void toggle_book_hint(bool enabled) {
+        // Repaint iff the book move should appear or disappear.
+        if constexpr (ANALYSIS) {
+            if (book.probe(game.position(), stone))
+                request_repaint();
+        }
+    }
+
+    void toggle_heatmap(bool enabled) {
+        // The heatmap, if enabled, is repainted once scored.
+        if (!enabled && shown_heatmap) {
+            shown_heatmap = nullopt;
+            request_repaint();
+        }
+        restart_analysis();
     }
 
     void toggle_ordinals(bool enabled) {
         // Repaint iff the ordinals should appear or disappear.
         if (game.move_index() != 0)
-            repaint();
+            request_repaint();
+    }
+
+    /// Changes the rule of the game to the one of the triggered action.
+    void change_rule(QAction *act) {
+        Rule rule = act == renju_act      ? Rule::Renju
+                    : act == standard_act ? Rule::Standard
+                                          : Rule::Freestyle;
+        if (rule == game.rule())
+            return;
+        game.set_rule(rule);
+        game_updated();
+    }
+
+    void suggest() {
+        // The continuous analysis already suggests the best move.
+        if (analyses_continuously())
+            return;
+        start_search(false);
     }
 
+    void computer_play() {
+        if (reviewing())
+            return;
+        start_search(true);
+    }
+
+    /// Starts a search for the current stone on the worker, either to
+    /// suggest or to play the best move found.
+    ///
+    /// The search is cancelled if the game or the current stone changes
+    /// in the meantime.
+    void start_search(bool play) {
+        if (!ANALYSIS || searching)
+            return;
+
+        searching = true;
+        suggest_act->setEnabled(false);
+        computer_play_act->setEnabled(false);
+
+        if constexpr (ANALYSIS) {
+            post_job(
+                [this, snapshot = game,
+                 stone = stone](const std::atomic<bool> &cancel) {
+                    SearchLimits limits;
+                    limits.time = ENGINE_TIME_LIMIT;
+                    limits.cancel = &cancel;
+                    return engine.search(snapshot, stone, limits).best;
+                },
+                [this, play](optional<Point> best) {
+                    search_finished(play, best);
+                });
+        }
+    }
+
+    /// Called on this thread when a search of the current position has
+    /// finished.
+    void search_finished(bool play, optional<Point> best) {
+        searching = false;
+        suggest_act->setEnabled(true);
+        computer_play_act->setEnabled(true);
+
+        if (!best)
+            return;
+        if (play) {
+            if (game.make_move(*best, stone))
+                game_updated();
+        } else {
+            suggestion = best;
+            request_repaint();
+        }
+    }
+
+    /// Exports the game as played, namely the past moves of the current
+    /// line, which any version can import.
     void export_game() {
-        QByteArray text = game.serialize()
-                              .toBase64(QByteArray::Base64UrlEncoding |
-                                        QByteArray::OmitTrailingEquals)
-                              .prepend(URI_PREFIX)
-                              .append(';');
         QClipboard *clipboard = QApplication::clipboard();
-        clipboard->setText(text);
+        clipboard->setText(encode_uri(game));
+    }
+
+    /// Exports the whole tree of variations, which ends up at the end of
+    /// the main line when imported.
+    void export_tree() {
+        QClipboard *clipboard = QApplication::clipboard();
+        clipboard->setText(encode_uri(game, true));
     }
 
     void import_game() {
         QClipboard *clipboard = QApplication::clipboard();
-        QByteArray text = clipboard->text().toUtf8().trimmed();
-        if (!text.startsWith(URI_PREFIX))
-            return import_failed(
-                "合法的五子棋对局 URI 应以 \"gomoku:\" 起始。");
-        text.remove(0, URI_PREFIX.size());
-
-        // This is to avoid importing a partially copied URI.
-        if (!text.endsWith(';'))
-            return import_failed("合法的五子棋对局 URI 应以 \";\" 结束。");
-        text.chop(1);
-
-        auto data = QByteArray::fromBase64Encoding(
-            text, QByteArray::Base64UrlEncoding |
-                      QByteArray::AbortOnBase64DecodingErrors);
-        if (!data)
-            return import_failed("Base64 解码失败。");
-
-        if (auto res = Game::deserialize(*data)) {
-            if (game.total_moves() != 0 &&
-                !confirm(this, QString("导入 %1 手棋并完全覆盖当前对局")
-                                   .arg(res->total_moves()))) {
-                return;
-            }
-            if (game != *res) {
-                game = *std::move(res);
-                game_updated();
+        UriError error;
+        auto res =
+            decode_uri<N>(clipboard->text().toUtf8(), &error, game.rule());
+        if (!res) {
+            switch (error) {
+            case UriError::MissingPrefix:
+                return import_failed(
+                    "合法的五子棋对局 URI 应以 \"gomoku:\" 起始。");
+            case UriError::MissingTerminator:
+                return import_failed(
+                    "合法的五子棋对局 URI 应以 \";\" 结束。");
+            case UriError::InvalidBase64:
+                return import_failed("Base64 解码失败。");
+            case UriError::InvalidGame:
+                return import_failed("反序列化失败。");
             }
-            review_act->setChecked(true);
-        } else {
-            import_failed("反序列化失败。");
         }
+
+        if (game.total_moves() != 0 &&
+            !confirm(this, QString("导入 %1 手棋并完全覆盖当前对局")
+                               .arg(res->total_moves()))) {
+            return;
+        }
+        // Games with the same line may differ in other variations.
+        game = *std::move(res);
+        game_updated();
+        review_act->setChecked(true);
     }
 
     /// Informs the user that the import attempt has failed.
@@ -459,10 +1319,137 @@ class BoardWidget : public QWidget {
     }
 };
 
+/// A panel next to the standard board showing the statistics of the
+/// games in the database, namely the results, the average length, the
+/// axes of the winning rows and the openings played the most.
+///
+/// The statistics are aggregated on a thread of its own when the panel
+/// is first shown, which is cancelled if the panel is destroyed before.
+/// Double-clicking an opening loads its moves onto the board.
+class ExplorerPanel : public QDockWidget {
+    BoardWidgetBase *board;
+    QLabel *summary;
+    QTreeWidget *opening_list;
+    vector<OpeningStats> openings;
+
+    // The statistics are only touched by the thread until it has posted
+    // their arrival, and are left empty if there is no database.
+    optional<ArchiveStats> stats;
+    std::atomic<bool> cancelled{false};
+    std::thread thread;
+
+  public:
+    explicit ExplorerPanel(BoardWidgetBase *board)
+        : QDockWidget("开局统计"), board(board) {
+        setFeatures(QDockWidget::DockWidgetClosable);
+        setAllowedAreas(Qt::RightDockWidgetArea);
+        setFixedWidth(EXPLORER_WIDTH);
+
+        summary = new QLabel("正在统计对局数据库…");
+        summary->setWordWrap(true);
+        opening_list = new QTreeWidget;
+        opening_list->setRootIsDecorated(false);
+        opening_list->setHeaderLabels({"开局", "对局数", "黑胜", "白胜"});
+        connect(opening_list, &QTreeWidget::itemDoubleClicked, this,
+                [this](QTreeWidgetItem *item) {
+                    const OpeningStats &opening =
+                        openings[item->data(0, Qt::UserRole).toULongLong()];
+                    this->board->load_moves(
+                        {opening.moves.data(), opening.len});
+                });
+
+        auto *content = new QWidget;
+        auto *layout = new QVBoxLayout(content);
+        layout->addWidget(summary);
+        layout->addWidget(opening_list);
+        setWidget(content);
+    }
+
+    ~ExplorerPanel() {
+        cancelled = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+  protected:
+    void showEvent(QShowEvent *event) override {
+        QDockWidget::showEvent(event);
+        // The thread stays joinable once started, until destruction.
+        if (!thread.joinable())
+            start_aggregation();
+    }
+
+  private:
+    void start_aggregation() {
+        QString path =
+            QCoreApplication::applicationDirPath() + '/' + DATABASE_FILE_NAME;
+        thread = std::thread([this, path] {
+            if (auto db = Database::open(path))
+                stats = aggregate_stats(
+                    *db, std::thread::hardware_concurrency(), &cancelled);
+            QMetaObject::invokeMethod(
+                this, [this] { aggregation_finished(); },
+                Qt::QueuedConnection);
+        });
+    }
+
+    /// Called on this thread when the statistics have been aggregated.
+    void aggregation_finished() {
+        if (!stats) {
+            summary->setText(
+                QString("未找到对局数据库 %1。").arg(DATABASE_FILE_NAME));
+            return;
+        }
+
+        auto percent = [](u64 part, u64 whole) {
+            return QString::number(whole == 0 ? 0.0 : 100.0 * part / whole,
+                                   'f', 1) +
+                   '%';
+        };
+        u64 games = stats->games;
+        u64 wins = stats->black_wins + stats->white_wins;
+        const auto &axes = stats->win_axes;
+        QString text =
+            QString("共 %1 局，平均 %2 手。\n"
+                    "黑胜 %3 · 白胜 %4 · 未分胜负 %5\n"
+                    "胜利行：横 %6 · 竖 %7 · 斜 ↘ %8 · 斜 ↗ %9")
+                .arg(games)
+                .arg(stats->average_length(), 0, 'f', 1)
+                .arg(percent(stats->black_wins, games))
+                .arg(percent(stats->white_wins, games))
+                .arg(percent(games - wins, games))
+                .arg(percent(axes[usize(Axis::Horizontal)], wins))
+                .arg(percent(axes[usize(Axis::Vertical)], wins))
+                .arg(percent(axes[usize(Axis::Descending)], wins))
+                .arg(percent(axes[usize(Axis::Ascending)], wins));
+        if (stats->invalid != 0)
+            text += QString("\n另有 %1 局无法读取。").arg(stats->invalid);
+        summary->setText(text);
+
+        for (const OpeningStats *opening :
+             stats->top_openings(EXPLORER_OPENINGS)) {
+            QStringList moves;
+            for (usize i = 0; i < opening->len; i++) {
+                Point p = opening->moves[i].pos;
+                moves.push_back(QString("(%1,%2)").arg(p.x).arg(p.y));
+            }
+            auto *item = new QTreeWidgetItem(opening_list);
+            item->setText(0, moves.join(' '));
+            item->setText(1, QString::number(opening->games));
+            item->setText(2, percent(opening->black_wins, opening->games));
+            item->setText(3, percent(opening->white_wins, opening->games));
+            item->setData(0, Qt::UserRole, qulonglong(openings.size()));
+            openings.push_back(*opening);
+        }
+        // Only the openings listed are kept.
+        stats = nullopt;
+    }
+};
+
 class MainWindow : public QMainWindow {
   protected:
     void closeEvent(QCloseEvent *event) override {
-        BoardWidget *widget = (BoardWidget *)centralWidget();
+        auto *widget = (BoardWidgetBase *)centralWidget();
         if (widget->can_close_now() || confirm(this, "使您丢失未保存的对局"))
             event->accept();
         else
@@ -473,12 +1460,43 @@ class MainWindow : public QMainWindow {
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
 
-    BoardWidget *widget = new BoardWidget();
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption size_opt({"s", "size"},
+                                "Board size, one of 15, 19 and 20.", "n",
+                                QString::number(BOARD_SIZE));
+    parser.addOption(size_opt);
+    parser.process(app);
+
+    // Each size is a separate instantiation, picked once here.
+    usize size = parser.value(size_opt).toUInt();
+    BoardWidgetBase *widget;
+    if (size == 15) {
+        widget = new BoardWidget<15>();
+    } else if (size == 19) {
+        widget = new BoardWidget<19>();
+    } else if (size == 20) {
+        widget = new BoardWidget<20>();
+    } else {
+        std::fprintf(stderr, "gomoku: unsupported board size %s\n",
+                     qPrintable(parser.value(size_opt)));
+        return 1;
+    }
     widget->setMouseTracking(true);
+    widget->setFixedSize(WINDOW_SIZE, WINDOW_SIZE);
 
     MainWindow window;
     window.setCentralWidget(widget);
-    window.setFixedSize(WINDOW_SIZE, WINDOW_SIZE);
+    // The window fits the board, the status bar showing the progress of
+    // searches below it, and the opening explorer when shown.
+    window.statusBar();
+    window.layout()->setSizeConstraint(QLayout::SetFixedSize);
+    if (size == BOARD_SIZE) {
+        auto *explorer = new ExplorerPanel(widget);
+        window.addDockWidget(Qt::RightDockWidgetArea, explorer);
+        explorer->hide();
+        widget->explorer_act = explorer->toggleViewAction();
+    }
     window.setWindowTitle("五子棋 (开局)");
 #ifndef Q_OS_WIN
     // Not needed on Windows, as the resource file already does the job.
@@ -0,0 +1,363 @@
+#include <QtCore>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "book.hpp"
+#include "core.hpp"
+#include "database.hpp"
+#include "engine.hpp"
+#include "game.hpp"
+#include "rules.hpp"
+
+/// Size of the transposition table of each engine, in MiB.
+const usize MATCH_HASH_MB = 16;
+
+/// Distance from the center within which opening moves are placed.
+const u32 OPENING_RADIUS = 3;
+
+/// Attempts at placing each opening move before giving up on it.
+const u32 OPENING_ATTEMPTS = 64;
+
+/// Confidence level of the Elo error margin, as a number of standard
+/// deviations (about 95%).
+const double ELO_ERROR_SIGMAS = 1.96;
+
+/// One of the two players of a match, called A and B.
+struct Player {
+    const char *name;
+    SearchLimits limits;
+    optional<Network> network;
+};
+
+/// The result of a game, from the perspective of player A.
+enum struct Outcome : u8 { Loss, Draw, Win };
+
+/// The scores of a match so far, from the perspective of player A.
+struct MatchScore {
+    u64 wins = 0, draws = 0, losses = 0;
+
+    u64 games() const { return wins + draws + losses; }
+
+    void add(Outcome outcome) {
+        switch (outcome) {
+        case Outcome::Win:
+            wins++;
+            break;
+        case Outcome::Draw:
+            draws++;
+            break;
+        case Outcome::Loss:
+            losses++;
+            break;
+        }
+    }
+
+    /// Returns the mean score per game and its variance per game.
+    pair<double, double> mean_and_variance() const {
+        double n = double(games());
+        double mean = (wins + 0.5 * draws) / n;
+        double var = (wins * (1 - mean) * (1 - mean) +
+                      draws * (0.5 - mean) * (0.5 - mean) +
+                      losses * mean * mean) /
+                     n;
+        return {mean, var};
+    }
+};
+
+/// Converts a mean score into an Elo difference under the logistic
+/// model.
+double elo_from_score(double score) {
+    score = std::clamp(score, 1e-6, 1 - 1e-6);
+    return -400 * std::log10(1 / score - 1);
+}
+
+/// Converts an Elo difference into a mean score under the logistic
+/// model. This is the inverse of `elo_from_score`.
+double score_from_elo(double elo) { return 1 / (1 + std::pow(10, -elo / 400)); }
+
+/// Returns the log-likelihood ratio of the hypothesis that A is `elo1`
+/// stronger than B against that of `elo0`, with the generalized SPRT
+/// under a normal approximation of the score.
+double sprt_llr(const MatchScore &score, double elo0, double elo1) {
+    if (score.wins + score.draws == 0 || score.losses + score.draws == 0)
+        return 0;
+    auto [mean, var] = score.mean_and_variance();
+    double s0 = score_from_elo(elo0), s1 = score_from_elo(elo1);
+    return score.games() * (s1 - s0) * (2 * mean - s0 - s1) / (2 * var);
+}
+
+/// Plays the seeded opening of a pair of games, namely a few random
+/// legal moves near the center, without a win.
+Game play_opening(u64 seed, u32 moves, Rule rule) {
+    Game game(rule);
+    u64 state = seed;
+    const u32 center = BOARD_SIZE / 2, width = 2 * OPENING_RADIUS + 1;
+    for (u32 i = 0; i < moves; i++) {
+        Stone stone = game.infer_turn();
+        for (u32 attempt = 0; attempt < OPENING_ATTEMPTS; attempt++) {
+            u64 r = splitmix64(state);
+            Point p(center - OPENING_RADIUS + r % width,
+                    center - OPENING_RADIUS + r / width % width);
+            if (game.make_move(p, stone)) {
+                if (!game.first_win())
+                    break;
+                game.undo();
+            }
+        }
+    }
+    return game;
+}
+
+/// Plays a game from an opening between two engines, one for each
+/// stone, returning the stone of the winner, or `None` for a draw.
+///
+/// A player that finds no legal move while the board is not full loses.
+Stone play_game(Game &game, Engine *engines[2], const Player *players[2]) {
+    while (!game.first_win()) {
+        Stone turn = game.infer_turn();
+        usize side = turn == Stone::Black ? 0 : 1;
+        if (game.move_index() == BOARD_SIZE * BOARD_SIZE)
+            return Stone::None;
+        SearchResult res =
+            engines[side]->search(game, turn, players[side]->limits);
+        if (!res.best || !game.make_move(*res.best, turn))
+            return opposite(turn);
+    }
+    return game.past_moves()[game.first_win()->index - 1].stone;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("gomoku-match");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Plays engine-vs-engine games from seeded openings in parallel, "
+        "writing a line of JSON for each game as soon as it is done, and "
+        "a summary with the Elo difference of player A over player B.");
+    parser.addHelpOption();
+    QCommandLineOption games_opt({"n", "games"},
+                                 "Number of games, in pairs of an opening "
+                                 "played with both colors.",
+                                 "n", "100");
+    QCommandLineOption threads_opt(
+        {"j", "threads"}, "Number of concurrent games.", "n",
+        QString::number(std::max(1u, std::thread::hardware_concurrency())));
+    QCommandLineOption seed_opt({"s", "seed"}, "Seed of the openings.", "n",
+                                "0");
+    QCommandLineOption opening_opt("opening-moves",
+                                   "Number of random moves in each opening.",
+                                   "n", "4");
+    QCommandLineOption time_a_opt("time-a", "Time per move of A.", "ms",
+                                  "100");
+    QCommandLineOption time_b_opt("time-b", "Time per move of B.", "ms",
+                                  "100");
+    QCommandLineOption nodes_a_opt(
+        "nodes-a", "Nodes per move of A, instead of time.", "n");
+    QCommandLineOption nodes_b_opt(
+        "nodes-b", "Nodes per move of B, instead of time.", "n");
+    QCommandLineOption network_a_opt(
+        "network-a", "Evaluate with the network in <file> for A.", "file");
+    QCommandLineOption network_b_opt(
+        "network-b", "Evaluate with the network in <file> for B.", "file");
+    QCommandLineOption rule_opt({"r", "rule"},
+                                "Rule: freestyle, standard or renju.",
+                                "rule", "freestyle");
+    QCommandLineOption book_opt({"b", "book"},
+                                "Opening book <file> shared by both players.",
+                                "file");
+    QCommandLineOption database_opt(
+        {"o", "database"},
+        "Write the games to a database <file>, in order of completion.",
+        "file");
+    QCommandLineOption sprt_opt(
+        "sprt",
+        "Stop once a SPRT of <elo0>,<elo1> for A over B concludes, with "
+        "false positive and negative rates of 5%.",
+        "elo0,elo1");
+    parser.addOptions({games_opt, threads_opt, seed_opt, opening_opt,
+                       time_a_opt, time_b_opt, nodes_a_opt, nodes_b_opt,
+                       network_a_opt, network_b_opt, rule_opt, book_opt,
+                       database_opt, sprt_opt});
+    parser.process(app);
+
+    u64 total = parser.value(games_opt).toULongLong();
+    usize workers = std::max(parser.value(threads_opt).toUInt(), 1u);
+    u64 seed = parser.value(seed_opt).toULongLong();
+    u32 opening_moves = parser.value(opening_opt).toUInt();
+
+    Player players[2] = {{"a", {}, nullopt}, {"b", {}, nullopt}};
+    const QCommandLineOption *time_opts[2] = {&time_a_opt, &time_b_opt};
+    const QCommandLineOption *nodes_opts[2] = {&nodes_a_opt, &nodes_b_opt};
+    const QCommandLineOption *network_opts[2] = {&network_a_opt,
+                                                 &network_b_opt};
+    for (usize i = 0; i < 2; i++) {
+        if (parser.isSet(*network_opts[i])) {
+            QString path = parser.value(*network_opts[i]);
+            players[i].network = Network::open(path);
+            if (!players[i].network) {
+                std::fprintf(stderr, "gomoku-match: cannot load network %s\n",
+                             qPrintable(path));
+                return 1;
+            }
+        }
+        SearchLimits &limits = players[i].limits;
+        if (parser.isSet(*nodes_opts[i])) {
+            limits.time = milliseconds(0);
+            limits.nodes = parser.value(*nodes_opts[i]).toULongLong();
+        } else {
+            limits.time =
+                milliseconds(parser.value(*time_opts[i]).toLongLong());
+        }
+    }
+
+    Rule rule;
+    QString rule_name = parser.value(rule_opt);
+    if (rule_name == "freestyle") {
+        rule = Rule::Freestyle;
+    } else if (rule_name == "standard") {
+        rule = Rule::Standard;
+    } else if (rule_name == "renju") {
+        rule = Rule::Renju;
+    } else {
+        std::fprintf(stderr, "gomoku-match: unknown rule %s\n",
+                     qPrintable(rule_name));
+        return 1;
+    }
+
+    optional<pair<double, double>> sprt;
+    if (parser.isSet(sprt_opt)) {
+        QStringList bounds = parser.value(sprt_opt).split(',');
+        bool ok0 = false, ok1 = false;
+        if (bounds.size() == 2)
+            sprt = {bounds[0].toDouble(&ok0), bounds[1].toDouble(&ok1)};
+        if (!ok0 || !ok1) {
+            std::fprintf(stderr, "gomoku-match: invalid --sprt bounds\n");
+            return 1;
+        }
+    }
+    const double alpha = 0.05, beta = 0.05;
+    const double llr_lower = std::log(beta / (1 - alpha));
+    const double llr_upper = std::log((1 - beta) / alpha);
+
+    // The book is only read, and loaded once by whichever thread probes
+    // it first, so that all engines share it.
+    optional<Book> book;
+    if (parser.isSet(book_opt))
+        book.emplace(parser.value(book_opt));
+
+    optional<DatabaseWriter> database;
+    if (parser.isSet(database_opt))
+        database.emplace(parser.value(database_opt));
+
+    // Games are claimed by index, and all else shared is only touched
+    // once a game is done.
+    std::atomic<u64> next_game{0};
+    std::atomic<bool> done{false};
+    std::mutex result_mutex;
+    MatchScore score;
+    optional<double> llr;
+    const char *verdict = nullptr;
+
+    auto work = [&] {
+        // Each player has an engine of its own, so that they never share
+        // a transposition table.
+        Engine engine_a(1, MATCH_HASH_MB), engine_b(1, MATCH_HASH_MB);
+        Engine *player_engines[2] = {&engine_a, &engine_b};
+        for (usize i = 0; i < 2; i++) {
+            player_engines[i]->set_book(book ? &*book : nullptr);
+            player_engines[i]->set_network(
+                players[i].network ? &*players[i].network : nullptr);
+        }
+
+        u64 i;
+        while (!done && (i = next_game++) < total) {
+            // Both games of a pair start from the same opening, with A as
+            // black in the first and as white in the second.
+            u64 pair_seed = seed ^ (i / 2) * 0x9e3779b97f4a7c15;
+            Game game = play_opening(pair_seed, opening_moves, rule);
+            bool a_black = i % 2 == 0;
+            Engine *engines[2] = {&engine_a, &engine_b};
+            const Player *sides[2] = {&players[0], &players[1]};
+            if (!a_black) {
+                std::swap(engines[0], engines[1]);
+                std::swap(sides[0], sides[1]);
+            }
+            engine_a.clear_hash();
+            engine_b.clear_hash();
+
+            Stone winner = play_game(game, engines, sides);
+            Outcome outcome = winner == Stone::None ? Outcome::Draw
+                              : (winner == Stone::Black) == a_black
+                                  ? Outcome::Win
+                                  : Outcome::Loss;
+
+            std::string out =
+                "{\"game\":" + std::to_string(i) + ",\"black\":\"" +
+                sides[0]->name + "\",\"moves\":" +
+                std::to_string(game.move_index()) + ",\"result\":\"" +
+                (outcome == Outcome::Draw  ? "draw"
+                 : outcome == Outcome::Win ? "a"
+                                           : "b") +
+                "\"}\n";
+
+            std::lock_guard lock(result_mutex);
+            std::fputs(out.c_str(), stdout);
+            if (database)
+                database->add(game);
+            score.add(outcome);
+            if (sprt && !verdict) {
+                llr = sprt_llr(score, sprt->first, sprt->second);
+                if (*llr <= llr_lower)
+                    verdict = "H0";
+                else if (*llr >= llr_upper)
+                    verdict = "H1";
+                if (verdict)
+                    done = true;
+            }
+        }
+    };
+
+    vector<std::thread> pool;
+    for (usize i = 0; i < workers; i++)
+        pool.emplace_back(work);
+    for (std::thread &thread : pool)
+        thread.join();
+
+    std::string summary = "{\"games\":" + std::to_string(score.games()) +
+                          ",\"wins\":" + std::to_string(score.wins) +
+                          ",\"draws\":" + std::to_string(score.draws) +
+                          ",\"losses\":" + std::to_string(score.losses);
+    if (score.games() != 0) {
+        auto [mean, var] = score.mean_and_variance();
+        double margin = ELO_ERROR_SIGMAS * std::sqrt(var / score.games());
+        double error = (elo_from_score(mean + margin) -
+                        elo_from_score(mean - margin)) /
+                       2;
+        summary += ",\"score\":" + std::to_string(mean) +
+                   ",\"elo\":" + std::to_string(elo_from_score(mean)) +
+                   ",\"elo_error\":" + std::to_string(error);
+    }
+    if (llr) {
+        summary += ",\"llr\":" + std::to_string(*llr) +
+                   ",\"llr_bounds\":[" + std::to_string(llr_lower) + "," +
+                   std::to_string(llr_upper) + "]";
+        if (verdict)
+            summary += ",\"sprt\":\"" + std::string(verdict) + "\"";
+    }
+    summary += "}\n";
+    std::fputs(summary.c_str(), stdout);
+    std::fflush(stdout);
+
+    if (database && !database->commit()) {
+        std::fprintf(stderr, "gomoku-match: cannot write %s\n",
+                     qPrintable(parser.value(database_opt)));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+
+#include <QFile>
+#include <QtEndian>
+
+#include "core.hpp"
+#include "eval.hpp"
+#include "simd.hpp"
+
+/// The magic bytes at the start of a network file.
+const char NNUE_MAGIC[8] = {'G', 'O', 'M', 'O', 'K', 'U', 'N', 'N'};
+
+/// The version of the network format.
+const u32 NNUE_VERSION = 1;
+
+/// Number of neurons in the hidden layer.
+const usize NNUE_HIDDEN = 128;
+
+/// Largest activation of a hidden neuron, which clips its accumulated
+/// value to `[0, NNUE_ACTIVATION_MAX]`.
+const i16 NNUE_ACTIVATION_MAX = 127;
+
+/// Largest magnitude of a score given by the network, well below the
+/// scores of forced wins.
+const i32 NNUE_MAX_SCORE = WIN_SCORE / 2;
+
+/// Size of the network header, in bytes.
+///
+/// The header consists of the magic bytes, the format version (`u32`),
+/// the board size (`u32`), the size of the hidden layer (`u32`) and the
+/// divisor of the output (`u32`), in order. All integers in a network
+/// file are little-endian.
+const usize NNUE_HEADER_SIZE = 24;
+
+/// Size of the weights following the header, in bytes.
+///
+/// The weights consist of the feature weights (`i16`), one column of
+/// `NNUE_HIDDEN` for each cell, first for the stones of a perspective
+/// and then for those of the other, followed by the hidden biases
+/// (`i16`), the output weights (`i8`) for the activations of the stone
+/// to play and then for those of the other, and the output bias (`i32`).
+const usize NNUE_WEIGHTS_SIZE =
+    2 * BOARD_SIZE * BOARD_SIZE * NNUE_HIDDEN * 2 + NNUE_HIDDEN * 2 +
+    2 * NNUE_HIDDEN + 4;
+
+// The vectorised kernels process 16 neurons at a time.
+static_assert(NNUE_HIDDEN % 16 == 0);
+
+/// The hidden layer of a network before activation, for each of the two
+/// perspectives, black and white.
+///
+/// Each value is the hidden bias plus the feature weights of the stones
+/// on the board, so that a move only adds or subtracts a column. The
+/// sums wrap around, which keeps the updates exactly reversible.
+struct alignas(32) Accumulator {
+    i16 values[2][NNUE_HIDDEN];
+};
+
+/// Adds a weight column to an accumulator.
+void nnue_add_scalar(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i++)
+        acc[i] = i16(acc[i] + column[i]);
+}
+
+/// Subtracts a weight column from an accumulator.
+void nnue_sub_scalar(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i++)
+        acc[i] = i16(acc[i] - column[i]);
+}
+
+/// Computes the dot product of the activations of an accumulator with
+/// output weights. This is the reference for the vectorised kernels,
+/// which must agree with it exactly.
+i32 nnue_output_scalar(const i16 *acc, const i8 *weights) {
+    i32 sum = 0;
+    for (usize i = 0; i < NNUE_HIDDEN; i++)
+        sum += std::clamp<i16>(acc[i], 0, NNUE_ACTIVATION_MAX) * weights[i];
+    return sum;
+}
+
+#ifdef GOMOKU_SIMD_X86
+
+/// Adds a weight column to an accumulator with SSE2.
+void nnue_add_sse2(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128((const __m128i *)(acc + i));
+        __m128i c = _mm_loadu_si128((const __m128i *)(column + i));
+        _mm_store_si128((__m128i *)(acc + i), _mm_add_epi16(a, c));
+    }
+}
+
+/// Subtracts a weight column from an accumulator with SSE2.
+void nnue_sub_sse2(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128((const __m128i *)(acc + i));
+        __m128i c = _mm_loadu_si128((const __m128i *)(column + i));
+        _mm_store_si128((__m128i *)(acc + i), _mm_sub_epi16(a, c));
+    }
+}
+
+/// Sums the 32-bit lanes.
+i32 hsum_epi32(__m128i x) {
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0x4e));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0xb1));
+    return _mm_cvtsi128_si32(x);
+}
+
+/// Computes the output dot product with SSE2, 16 neurons at a time.
+i32 nnue_output_sse2(const i16 *acc, const i8 *weights) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(NNUE_ACTIVATION_MAX);
+    __m128i sum = zero;
+    for (usize i = 0; i < NNUE_HIDDEN; i += 16) {
+        // Sign-extend the weights by unpacking them into the high bytes
+        // of 16-bit lanes and shifting them back down.
+        __m128i w = _mm_loadu_si128((const __m128i *)(weights + i));
+        __m128i w_lo = _mm_srai_epi16(_mm_unpacklo_epi8(zero, w), 8);
+        __m128i w_hi = _mm_srai_epi16(_mm_unpackhi_epi8(zero, w), 8);
+        __m128i a_lo = _mm_load_si128((const __m128i *)(acc + i));
+        __m128i a_hi = _mm_load_si128((const __m128i *)(acc + i + 8));
+        a_lo = _mm_min_epi16(_mm_max_epi16(a_lo, zero), max);
+        a_hi = _mm_min_epi16(_mm_max_epi16(a_hi, zero), max);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a_lo, w_lo));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a_hi, w_hi));
+    }
+    return hsum_epi32(sum);
+}
+
+/// Adds a weight column to an accumulator with AVX2.
+GOMOKU_TARGET_AVX2 void nnue_add_avx2(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256((const __m256i *)(acc + i));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(column + i));
+        _mm256_store_si256((__m256i *)(acc + i), _mm256_add_epi16(a, c));
+    }
+}
+
+/// Subtracts a weight column from an accumulator with AVX2.
+GOMOKU_TARGET_AVX2 void nnue_sub_avx2(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256((const __m256i *)(acc + i));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(column + i));
+        _mm256_store_si256((__m256i *)(acc + i), _mm256_sub_epi16(a, c));
+    }
+}
+
+/// Computes the output dot product with AVX2, 16 neurons at a time.
+GOMOKU_TARGET_AVX2 i32 nnue_output_avx2(const i16 *acc, const i8 *weights) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(NNUE_ACTIVATION_MAX);
+    __m256i sum = zero;
+    for (usize i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i w = _mm256_cvtepi8_epi16(
+            _mm_loadu_si128((const __m128i *)(weights + i)));
+        __m256i a = _mm256_load_si256((const __m256i *)(acc + i));
+        a = _mm256_min_epi16(_mm256_max_epi16(a, zero), max);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, w));
+    }
+    return hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(sum),
+                                    _mm256_extracti128_si256(sum, 1)));
+}
+
+#endif
+
+#ifdef GOMOKU_SIMD_NEON
+
+/// Adds a weight column to an accumulator with NEON.
+void nnue_add_neon(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i += 8) {
+        int16x8_t a = vld1q_s16(acc + i), c = vld1q_s16(column + i);
+        vst1q_s16(acc + i, vaddq_s16(a, c));
+    }
+}
+
+/// Subtracts a weight column from an accumulator with NEON.
+void nnue_sub_neon(i16 *acc, const i16 *column) {
+    for (usize i = 0; i < NNUE_HIDDEN; i += 8) {
+        int16x8_t a = vld1q_s16(acc + i), c = vld1q_s16(column + i);
+        vst1q_s16(acc + i, vsubq_s16(a, c));
+    }
+}
+
+/// Computes the output dot product with NEON, 8 neurons at a time.
+i32 nnue_output_neon(const i16 *acc, const i8 *weights) {
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t max = vdupq_n_s16(NNUE_ACTIVATION_MAX);
+    int32x4_t sum = vdupq_n_s32(0);
+    for (usize i = 0; i < NNUE_HIDDEN; i += 8) {
+        int16x8_t a = vminq_s16(vmaxq_s16(vld1q_s16(acc + i), zero), max);
+        int16x8_t w = vmovl_s8(vld1_s8(weights + i));
+        sum = vmlal_s16(sum, vget_low_s16(a), vget_low_s16(w));
+        sum = vmlal_high_s16(sum, a, w);
+    }
+    return vaddvq_s32(sum);
+}
+
+#endif
+
+/// The kernels of the network.
+struct NnueKernels {
+    void (*add)(i16 *acc, const i16 *column);
+    void (*sub)(i16 *acc, const i16 *column);
+    i32 (*output)(const i16 *acc, const i8 *weights);
+};
+
+/// Selects the fastest kernels of the network supported at run time.
+NnueKernels select_nnue_kernels() {
+#if defined(GOMOKU_SIMD_X86)
+    if (cpu_has_avx2())
+        return {nnue_add_avx2, nnue_sub_avx2, nnue_output_avx2};
+    return {nnue_add_sse2, nnue_sub_sse2, nnue_output_sse2};
+#elif defined(GOMOKU_SIMD_NEON)
+    return {nnue_add_neon, nnue_sub_neon, nnue_output_neon};
+#else
+    return {nnue_add_scalar, nnue_sub_scalar, nnue_output_scalar};
+#endif
+}
+
+/// The kernels of the network selected at startup.
+const NnueKernels NNUE_KERNELS = select_nnue_kernels();
+
+/// A quantised evaluation network with a single hidden layer,
+/// memory-mapped from a file.
+///
+/// The features are the stones on the board, from the perspective of
+/// each stone. A position is scored from the clipped activations of the
+/// stone to play and of the other, so that the cost of an evaluation is
+/// proportional to the hidden layer rather than to the board, as long
+/// as the accumulator is updated move by move.
+class Network {
+    std::unique_ptr<QFile> file;
+    const i16 *features = nullptr;
+    const i16 *biases = nullptr;
+    const i8 *output_weights = nullptr;
+    i32 output_bias = 0;
+    i32 divisor = 1;
+
+    const i16 *column(usize plane, Point p) const {
+        return features +
+               (plane * BOARD_SIZE * BOARD_SIZE + p.y * BOARD_SIZE + p.x) *
+                   NNUE_HIDDEN;
+    }
+
+  public:
+    /// Opens and maps a network file, returning `nullopt` if the file
+    /// cannot be mapped or is not a valid network.
+    ///
+    /// The weights are used in place, so only little-endian hosts are
+    /// supported.
+    static optional<Network> open(const QString &path) {
+        if constexpr (std::endian::native != std::endian::little)
+            return nullopt;
+
+        Network net;
+        net.file = std::make_unique<QFile>(path);
+        if (!net.file->open(QIODevice::ReadOnly) ||
+            u64(net.file->size()) != NNUE_HEADER_SIZE + NNUE_WEIGHTS_SIZE)
+            return nullopt;
+        const u8 *base = net.file->map(0, net.file->size());
+        if (!base)
+            return nullopt;
+
+        if (std::memcmp(base, NNUE_MAGIC, sizeof NNUE_MAGIC) != 0 ||
+            qFromLittleEndian<u32>(base + 8) != NNUE_VERSION ||
+            qFromLittleEndian<u32>(base + 12) != BOARD_SIZE ||
+            qFromLittleEndian<u32>(base + 16) != NNUE_HIDDEN)
+            return nullopt;
+        u32 divisor = qFromLittleEndian<u32>(base + 20);
+        if (divisor == 0 || divisor > u32(INT32_MAX))
+            return nullopt;
+
+        const u8 *weights = base + NNUE_HEADER_SIZE;
+        net.features = reinterpret_cast<const i16 *>(weights);
+        net.biases = net.features + 2 * BOARD_SIZE * BOARD_SIZE * NNUE_HIDDEN;
+        net.output_weights =
+            reinterpret_cast<const i8 *>(net.biases + NNUE_HIDDEN);
+        net.output_bias =
+            qFromLittleEndian<i32>(net.output_weights + 2 * NNUE_HIDDEN);
+        net.divisor = i32(divisor);
+        return net;
+    }
+
+    /// Computes an accumulator from scratch for a board.
+    void refresh(Accumulator &acc, const Board &board) const {
+        for (auto &values : acc.values)
+            std::memcpy(values, biases, sizeof values);
+        for (u32 y = 0; y < BOARD_SIZE; y++) {
+            for (u32 x = 0; x < BOARD_SIZE; x++) {
+                Stone stone = board.at(Point(x, y));
+                if (stone != Stone::None)
+                    add(acc, Point(x, y), stone);
+            }
+        }
+    }
+
+    /// Updates an accumulator for a stone placed at a point.
+    void add(Accumulator &acc, Point p, Stone stone) const {
+        usize own = usize(stone) - 1;
+        NNUE_KERNELS.add(acc.values[own], column(0, p));
+        NNUE_KERNELS.add(acc.values[1 - own], column(1, p));
+    }
+
+    /// Updates an accumulator for a stone removed from a point.
+    void remove(Accumulator &acc, Point p, Stone stone) const {
+        usize own = usize(stone) - 1;
+        NNUE_KERNELS.sub(acc.values[own], column(0, p));
+        NNUE_KERNELS.sub(acc.values[1 - own], column(1, p));
+    }
+
+    /// Evaluates the position of an accumulator statically from the
+    /// perspective of a stone, on the scale of the pattern evaluation.
+    i32 evaluate(const Accumulator &acc, Stone stone) const {
+        usize own = usize(stone) - 1;
+        i64 sum = i64(output_bias) +
+                  NNUE_KERNELS.output(acc.values[own], output_weights) +
+                  NNUE_KERNELS.output(acc.values[1 - own],
+                                      output_weights + NNUE_HIDDEN);
+        return i32(std::clamp<i64>(sum / divisor, -NNUE_MAX_SCORE,
+                                   NNUE_MAX_SCORE));
+    }
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "core.hpp"
+
+/// A pattern formed by a stone along a line, ordered by strength.
+enum struct Pattern : u8 {
+    None,
+    /// Can become a three with one more stone.
+    Two,
+    /// Can become an open three with one more stone.
+    OpenTwo,
+    /// Can become a four with one more stone.
+    Three,
+    /// Can become an open four with one more stone.
+    OpenThree,
+    /// Can become a five with one more stone, at exactly one point.
+    Four,
+    /// Can become a five with one more stone, at two or more points.
+    OpenFour,
+    /// A five, or a longer row if longer rows count as fives.
+    Five,
+    /// A row longer than five, if longer rows do not count as fives.
+    Overline,
+};
+
+/// Number of cells on each side of the center of a pattern window.
+const u32 PATTERN_REACH = 4;
+
+/// Number of cells on each side of the center of a window that also
+/// sees the cells just beyond any five through the center, which it
+/// takes to tell a five from an overline.
+const u32 EXACT_PATTERN_REACH = PATTERN_REACH + 1;
+
+/// Number of cells in a pattern window, excluding the center.
+const u32 PATTERN_CELLS = 2 * PATTERN_REACH;
+
+/// Returns the number of distinct pattern windows of a reach, each cell
+/// being either empty, occupied by the stone, or blocked by the opposite
+/// stone or the board boundary.
+constexpr usize pattern_windows(u32 reach) {
+    usize n = 1;
+    for (u32 i = 0; i < 2 * reach; i++)
+        n *= 3;
+    return n;
+}
+
+/// Number of distinct pattern windows.
+const usize PATTERN_WINDOWS = pattern_windows(PATTERN_REACH);
+
+/// Base-3 values of the bit masks of the cells of pattern windows of a
+/// reach `R`, so that a window with the cells in `own` occupied and
+/// those in `blocked` blocked has the index
+/// `BASE3<R>[own] + 2 * BASE3<R>[blocked]`.
+template <u32 Reach>
+const auto BASE3 = [] {
+    std::array<u16, 1 << (2 * Reach)> values{};
+    for (u32 mask = 0; mask < values.size(); mask++) {
+        u32 value = 0, pow = 1;
+        for (u32 i = 0; i < 2 * Reach; i++, pow *= 3)
+            value += (mask >> i & 1) * pow;
+        values[mask] = u16(value);
+    }
+    return values;
+}();
+
+/// Generates the pattern table of windows of a reach, where
+/// `exact_five` tells whether rows longer than five are overlines rather
+/// than fives.
+///
+/// The pattern of a window is derived from the patterns of the windows
+/// with one more stone, which have greater indices, so the table is
+/// filled in descending order of index. A window sees too little to
+/// tell a five from an overline when the five reaches its edge, so
+/// tables with `exact_five` are only built on windows of at least
+/// `EXACT_PATTERN_REACH`.
+template <u32 Reach>
+constexpr std::array<Pattern, pattern_windows(Reach)>
+generate_pattern_table(bool exact_five) {
+    const u32 cells_len = 2 * Reach;
+    std::array<Pattern, pattern_windows(Reach)> table{};
+    for (usize index = table.size(); index-- > 0;) {
+        // Decode the cells, with the center at `Reach`.
+        u8 cells[cells_len + 1] = {};
+        usize rest = index;
+        for (u32 i = 0; i <= cells_len; i++) {
+            if (i == Reach) {
+                cells[i] = 1;
+                continue;
+            }
+            cells[i] = rest % 3;
+            rest /= 3;
+        }
+
+        u32 len = 1;
+        for (u32 i = Reach; i-- > 0 && cells[i] == 1;)
+            len++;
+        for (u32 i = Reach + 1; i <= cells_len && cells[i] == 1; i++)
+            len++;
+        if (len >= 5) {
+            table[index] =
+                len > 5 && exact_five ? Pattern::Overline : Pattern::Five;
+            continue;
+        }
+
+        u32 fives = 0;
+        bool open_four = false, four = false, open_three = false,
+             three = false;
+        usize pow = 1;
+        for (u32 i = 0; i <= cells_len; i++) {
+            if (i == Reach)
+                continue;
+            if (cells[i] == 0) {
+                switch (table[index + pow]) {
+                case Pattern::Five:
+                    fives++;
+                    break;
+                case Pattern::OpenFour:
+                    open_four = true;
+                    break;
+                case Pattern::Four:
+                    four = true;
+                    break;
+                case Pattern::OpenThree:
+                    open_three = true;
+                    break;
+                case Pattern::Three:
+                    three = true;
+                    break;
+                default:
+                    break;
+                }
+            }
+            pow *= 3;
+        }
+
+        if (fives >= 2)
+            table[index] = Pattern::OpenFour;
+        else if (fives == 1)
+            table[index] = Pattern::Four;
+        else if (open_four)
+            table[index] = Pattern::OpenThree;
+        else if (four)
+            table[index] = Pattern::Three;
+        else if (open_three)
+            table[index] = Pattern::OpenTwo;
+        else if (three)
+            table[index] = Pattern::Two;
+        else
+            table[index] = Pattern::None;
+    }
+    return table;
+}
+
+/// The pattern table where rows longer than five count as fives.
+constexpr auto PATTERN_TABLE = generate_pattern_table<PATTERN_REACH>(false);
+
+/// Returns the index of the pattern window of a reach through a point on
+/// a line along the axis, as if the point were occupied by the stone.
+///
+/// The window is cut out of the line bit masks with a few shifts, with
+/// the points beyond the board boundary padded as blocked.
+template <usize N, u32 Reach = PATTERN_REACH>
+usize pattern_window(const BasicBoard<N> &board, Point p, Stone stone,
+                     Axis axis) {
+    typedef typename Geometry<N>::Line Line;
+    // Wide enough for a line padded on both sides.
+    typedef std::conditional_t<(N <= 16), u32, u64> Ext;
+
+    auto [line, bit] = line_pos<N>(p, axis);
+    Line own = board.line(stone, line);
+    Line blocked =
+        board.line(opposite(stone), line) | ~BasicBoard<N>::LINE_MASKS[line];
+
+    const u32 reach = Reach, width = 2 * Reach + 1;
+    const Ext pad = (1 << reach) - 1;
+    Ext own_ext = Ext(own) << reach;
+    Ext blocked_ext = Ext(blocked) << reach | pad |
+                      pad << (Geometry<N>::LINE_BITS + reach);
+
+    u32 own_window = own_ext >> bit & ((1 << width) - 1);
+    u32 blocked_window = blocked_ext >> bit & ((1 << width) - 1);
+
+    // Drop the center.
+    auto squeeze = [=](u32 w) {
+        return (w & pad) | (w >> (reach + 1)) << reach;
+    };
+    return BASE3<Reach>[squeeze(own_window)] +
+           2 * BASE3<Reach>[squeeze(blocked_window)];
+}
+
+/// Scans the patterns through a point along all axes, in the order of
+/// `AXES`, as if the point were occupied by the stone.
+///
+/// Unlike `Board::scan_row`, which only counts contiguous stones, this
+/// classifies the 9-cell window through the point on each axis with
+/// a lookup in a precomputed table.
+template <usize N>
+std::array<Pattern, 4> scan_patterns(const BasicBoard<N> &board, Point p,
+                                     Stone stone) {
+    std::array<Pattern, 4> patterns;
+    for (Axis axis : AXES)
+        patterns[usize(axis)] =
+            PATTERN_TABLE[pattern_window(board, p, stone, axis)];
+    return patterns;
+}
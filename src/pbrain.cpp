@@ -0,0 +1,395 @@
+#include <QtCore>
+
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "book.hpp"
+#include "core.hpp"
+#include "engine.hpp"
+#include "game.hpp"
+
+/// Name of the opening book file, next to the executable.
+const char BOOK_FILE_NAME[] = "gomoku.book";
+
+/// Time per move before the manager tells otherwise.
+const milliseconds DEFAULT_TURN_TIME(5000);
+
+/// Time kept in reserve for each move, for the latency of the output
+/// and of the manager.
+const milliseconds TIME_MARGIN(30);
+
+/// Minimum time budget of a move, also used when the manager asks to
+/// play as fast as possible.
+const milliseconds MIN_MOVE_TIME(10);
+
+/// Number of moves that the time left in the match is assumed to be
+/// shared among.
+const i32 MOVES_TO_GO = 20;
+
+/// Largest transposition table the engine takes under a memory limit.
+const usize MAX_HASH_MB = 256;
+
+/// A line of input, along with the time it was received.
+struct Command {
+    std::string line;
+    steady_clock::time_point received;
+};
+
+/// A queue of commands, read from stdin on a thread of its own, so that
+/// commands keep arriving while a search runs.
+class CommandQueue {
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::deque<Command> commands;
+    std::thread reader;
+
+  public:
+    /// Starts reading stdin. At the end of the input, `END` is pushed.
+    CommandQueue() {
+        reader = std::thread([this] {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                push({line, steady_clock::now()});
+            }
+            push({"END", steady_clock::now()});
+        });
+        // The reader blocks on stdin, which cannot be woken portably,
+        // and it is done by the time the input is.
+        reader.detach();
+    }
+
+    void push(Command command) {
+        std::lock_guard lock(mutex);
+        commands.push_back(std::move(command));
+        not_empty.notify_one();
+    }
+
+    /// Pops a command, blocking while there is none.
+    Command pop() {
+        std::unique_lock lock(mutex);
+        not_empty.wait(lock, [&] { return !commands.empty(); });
+        Command command = std::move(commands.front());
+        commands.pop_front();
+        return command;
+    }
+};
+
+/// A manager of the time of moves, following the limits set by the
+/// `INFO` command. Zero means no limit for the match, or for a move,
+/// to play as fast as possible.
+struct TimeManager {
+    milliseconds turn = DEFAULT_TURN_TIME;
+    milliseconds match{0};
+    optional<milliseconds> left;
+
+    /// Returns the time budget of a move, counted from the time its
+    /// command was received.
+    ///
+    /// The budget is the time per move, or a share of the time left in
+    /// the match if that is less, minus the margin.
+    milliseconds budget() const {
+        milliseconds budget = turn.count() != 0 ? turn - TIME_MARGIN
+                                                : MIN_MOVE_TIME;
+        if (match.count() != 0 && left)
+            budget = std::min(budget, *left / MOVES_TO_GO - TIME_MARGIN);
+        return std::max(budget, MIN_MOVE_TIME);
+    }
+};
+
+/// Parses a point in the form of `x,y`, as on the board.
+optional<Point> parse_point(const std::string &text) {
+    unsigned x, y;
+    char tail;
+    if (std::sscanf(text.c_str(), "%u,%u%c", &x, &y, &tail) != 2)
+        return nullopt;
+    Point p(x, y);
+    if (!in_board(p))
+        return nullopt;
+    return p;
+}
+
+/// A brain speaking the Gomocup protocol on stdin and stdout.
+///
+/// Commands are read on a thread of their own and handled in turn on
+/// the main thread, while the search for a move runs on another thread
+/// and writes the move when it finishes. After a move, the brain
+/// ponders, searching the position for the opponent until the next
+/// command, so that the transposition table is warm for the reply.
+class Brain {
+    CommandQueue commands;
+    std::mutex output_mutex;
+
+    Engine engine;
+    Book book;
+    Game game;
+    TimeManager time;
+    bool ponders;
+    // The size of the transposition table to take before the next search.
+    optional<usize> pending_hash_mb;
+
+    // The search thread, if a search is running, whether it is for a
+    // move to play rather than pondering, and whether it is cancelled.
+    std::thread search_thread;
+    std::atomic<bool> thinking{false};
+    std::atomic<bool> cancelled{false};
+
+    /// Writes a line of output.
+    void respond(const std::string &line) {
+        std::lock_guard lock(output_mutex);
+        std::fputs((line + '\n').c_str(), stdout);
+        std::fflush(stdout);
+    }
+
+    /// Stops the search (if any) and waits for it to finish, discarding
+    /// its result.
+    void stop_search() {
+        thinking = false;
+        cancelled = true;
+        if (search_thread.joinable())
+            search_thread.join();
+        cancelled = false;
+    }
+
+    /// Makes a move of the stone to play, returning whether it is legal.
+    bool play(Point p) { return game.make_move(p, game.infer_turn()); }
+
+    /// Starts to search for a move for the stone to play, writing it
+    /// once found and then pondering on the reply.
+    void think(steady_clock::time_point received) {
+        stop_search();
+        if (pending_hash_mb) {
+            engine.set_hash_size(*pending_hash_mb);
+            pending_hash_mb = nullopt;
+        }
+        auto spent = std::chrono::duration_cast<milliseconds>(
+            steady_clock::now() - received);
+        SearchLimits limits;
+        limits.time = std::max(time.budget() - spent, milliseconds(1));
+        limits.cancel = &cancelled;
+
+        thinking = true;
+        search_thread = std::thread([this, limits] {
+            Stone stone = game.infer_turn();
+            SearchResult res = engine.search(game, stone, limits);
+            if (!thinking)
+                return;
+            thinking = false;
+
+            optional<Point> best = res.best;
+            if (!best || !game.make_move(*best, stone)) {
+                respond("ERROR no move to play");
+                return;
+            }
+            respond(std::to_string(best->x) + "," + std::to_string(best->y));
+            if (ponders && !game.first_win()) {
+                SearchLimits ponder;
+                ponder.time = milliseconds(0);
+                ponder.cancel = &cancelled;
+                engine.search(game, game.infer_turn(), ponder);
+            }
+        });
+    }
+
+    /// Shows the progress of the search for a move to the manager.
+    void report(const SearchResult &res) {
+        if (!thinking)
+            return;
+        std::string line = "MESSAGE depth " + std::to_string(res.depth) +
+                           " score " + std::to_string(res.score) +
+                           " nodes " + std::to_string(res.nodes) +
+                           " time " + std::to_string(res.elapsed.count()) +
+                           " pv";
+        for (Point p : res.pv)
+            line += " " + std::to_string(p.x) + "," + std::to_string(p.y);
+        respond(line);
+    }
+
+    /// Handles an `INFO` command.
+    void info(const std::string &key, const std::string &value) {
+        long long n = std::atoll(value.c_str());
+        if (key == "timeout_turn") {
+            time.turn = milliseconds(n);
+        } else if (key == "timeout_match") {
+            time.match = milliseconds(n);
+        } else if (key == "time_left") {
+            time.left = milliseconds(n);
+        } else if (key == "max_memory" && n > 0) {
+            // Leave half of the memory to the rest of the brain.
+            pending_hash_mb = std::clamp<usize>(usize(n) >> 21, 1, MAX_HASH_MB);
+        } else if (key == "rule") {
+            // Bit 0 asks for exactly five, and bit 2 for renju.
+            Rule rule = n & 4   ? Rule::Renju
+                        : n & 1 ? Rule::Standard
+                                : Rule::Freestyle;
+            if (rule != game.rule()) {
+                stop_search();
+                game.set_rule(rule);
+            }
+        }
+    }
+
+    /// Reads the stones of a `BOARD` command up to `DONE`, returning
+    /// whether they make a valid position.
+    ///
+    /// The stones of the brain are marked with 1 and those of the
+    /// opponent with 2, so the brain plays black if both have as many.
+    bool read_board() {
+        vector<pair<Point, u32>> stones;
+        usize own = 0;
+        bool valid = true;
+        for (;;) {
+            std::string line = commands.pop().line;
+            if (line == "DONE")
+                break;
+            if (line == "END")
+                std::exit(0);
+            unsigned x, y, field;
+            if (std::sscanf(line.c_str(), "%u,%u,%u", &x, &y, &field) != 3 ||
+                !in_board(Point(x, y)) || field < 1 || field > 3) {
+                valid = false;
+                continue;
+            }
+            stones.push_back({Point(x, y), field});
+            own += field == 1;
+        }
+
+        Stone mine = 2 * own == stones.size() ? Stone::Black : Stone::White;
+        game = Game(game.rule());
+        for (auto [p, field] : stones) {
+            Stone stone = field == 1 ? mine : opposite(mine);
+            valid &= game.make_move(p, stone);
+        }
+        return valid;
+    }
+
+  public:
+    explicit Brain(const QString &book_path, const Network *network,
+                   bool ponders)
+        : engine(std::thread::hardware_concurrency()), book(book_path),
+          ponders(ponders) {
+        engine.set_book(&book);
+        engine.set_network(network);
+        engine.set_progress_handler(
+            [this](const SearchResult &res) { report(res); },
+            milliseconds(1000));
+    }
+
+    ~Brain() { stop_search(); }
+
+    /// Handles commands until `END`.
+    void run() {
+        for (;;) {
+            auto [line, received] = commands.pop();
+            std::string cmd = line.substr(0, line.find(' '));
+            std::string args = cmd.size() < line.size()
+                                   ? line.substr(cmd.size() + 1)
+                                   : std::string();
+            for (char &c : cmd)
+                c = std::toupper(u8(c));
+
+            if (cmd == "END") {
+                return;
+            } else if (cmd == "INFO") {
+                usize space = args.find(' ');
+                info(args.substr(0, space),
+                     space == std::string::npos ? "" : args.substr(space + 1));
+            } else if (cmd == "START") {
+                stop_search();
+                if (std::atoi(args.c_str()) != int(BOARD_SIZE)) {
+                    respond("ERROR only " + std::to_string(BOARD_SIZE) +
+                            "x" + std::to_string(BOARD_SIZE) +
+                            " boards are supported");
+                    continue;
+                }
+                game = Game(game.rule());
+                respond("OK");
+            } else if (cmd == "RECTSTART") {
+                respond("ERROR rectangular boards are not supported");
+            } else if (cmd == "RESTART") {
+                stop_search();
+                game = Game(game.rule());
+                respond("OK");
+            } else if (cmd == "BEGIN") {
+                stop_search();
+                think(received);
+            } else if (cmd == "TURN") {
+                stop_search();
+                auto p = parse_point(args);
+                if (!p || !play(*p)) {
+                    respond("ERROR invalid move " + args);
+                    continue;
+                }
+                think(received);
+            } else if (cmd == "BOARD") {
+                stop_search();
+                if (!read_board()) {
+                    respond("ERROR invalid board");
+                    continue;
+                }
+                think(received);
+            } else if (cmd == "TAKEBACK") {
+                stop_search();
+                auto p = parse_point(args);
+                auto past = game.past_moves();
+                if (!p || past.empty() || !(past.back().pos == *p)) {
+                    respond("ERROR invalid takeback " + args);
+                    continue;
+                }
+                game.undo();
+                respond("OK");
+            } else if (cmd == "ABOUT") {
+                respond("name=\"gomoku-qt\", version=\"" +
+                        std::string(GOMOKU_VERSION) +
+                        "\", author=\"Scallop Ye\"");
+            } else if (!cmd.empty()) {
+                respond("UNKNOWN " + cmd);
+            }
+        }
+    }
+};
+
+int main(int argc, char *argv[]) {
+    // Only the core application is set up, and the book and the
+    // transposition table are loaded and allocated by the first search,
+    // so that startup stays fast.
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("gomoku-pbrain");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Plays gomoku under the Gomocup protocol on stdin and stdout.");
+    parser.addHelpOption();
+    QCommandLineOption no_ponder_opt(
+        "no-ponder", "Do not search on the time of the opponent.");
+    QCommandLineOption network_opt(
+        "network", "Evaluate with the network in <file> instead of the "
+                   "patterns.",
+        "file");
+    parser.addOptions({no_ponder_opt, network_opt});
+    parser.process(app);
+
+    // Unlike the book, the network is loaded at startup, as a missing or
+    // invalid one must be reported before the manager starts a game.
+    optional<Network> network;
+    if (parser.isSet(network_opt)) {
+        network = Network::open(parser.value(network_opt));
+        if (!network) {
+            std::fprintf(stderr, "gomoku-pbrain: cannot load network %s\n",
+                         qPrintable(parser.value(network_opt)));
+            return 1;
+        }
+    }
+
+    Brain brain(QCoreApplication::applicationDirPath() + '/' + BOOK_FILE_NAME,
+                network ? &*network : nullptr, !parser.isSet(no_ponder_opt));
+    brain.run();
+    return 0;
+}
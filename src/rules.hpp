@@ -0,0 +1,285 @@
+#pragma once
+
+#include "core.hpp"
+#include "pattern.hpp"
+
+/// The pattern table where rows longer than five are overlines, on
+/// windows wide enough to see the cell beyond either end of a five.
+///
+/// It is too large to build at compile time, and is built on startup.
+const auto EXACT_PATTERN_TABLE =
+    generate_pattern_table<EXACT_PATTERN_REACH>(true);
+
+/// Number of cells in a window of `EXACT_PATTERN_TABLE`, excluding the
+/// center.
+const u32 EXACT_PATTERN_CELLS = 2 * EXACT_PATTERN_REACH;
+
+/// Returns the index in `EXACT_PATTERN_TABLE` of the window through a
+/// point on a line along the axis, as if the point were occupied by the
+/// stone.
+template <usize N>
+usize exact_pattern_window(const BasicBoard<N> &board, Point p, Stone stone,
+                           Axis axis) {
+    return pattern_window<N, EXACT_PATTERN_REACH>(board, p, stone, axis);
+}
+
+/// A move forbidden to black under renju.
+enum struct Foul : u8 { None, DoubleThree, DoubleFour, Overline };
+
+/// Maximum depth of the recursion in checking if a three is real,
+/// beyond which threes are assumed to be real.
+const u32 FOUL_DEPTH = 3;
+
+/// Returns the offset from the center of the cell at an index in
+/// a window of `EXACT_PATTERN_TABLE`, from which the center is dropped.
+constexpr i32 window_offset(u32 i) {
+    const i32 reach = EXACT_PATTERN_REACH;
+    return i < EXACT_PATTERN_REACH ? i32(i) - reach : i32(i) - reach + 1;
+}
+
+/// Returns the number of fours that black makes on a line with the
+/// window of `EXACT_PATTERN_TABLE`.
+///
+/// A straight four counts as one, with its two fives five cells apart
+/// at both ends. Any other pattern with two fives, such as `X_XXX_X`,
+/// counts as two fours on the same line.
+u32 count_fours(usize window) {
+    Pattern pattern = EXACT_PATTERN_TABLE[window];
+    if (pattern == Pattern::Four)
+        return 1;
+    if (pattern != Pattern::OpenFour)
+        return 0;
+
+    u32 fives = 0;
+    usize pow = 1;
+    for (u32 i = 0; i < EXACT_PATTERN_CELLS; i++, pow *= 3) {
+        if (window / pow % 3 == 0 &&
+            EXACT_PATTERN_TABLE[window + pow] == Pattern::Five)
+            fives |= 1 << i;
+    }
+    if (std::popcount(fives) != 2)
+        return 2;
+    i32 first = window_offset(std::countr_zero(fives));
+    i32 last = window_offset(31 - std::countl_zero(fives));
+    return last - first == 5 ? 1 : 2;
+}
+
+/// Classifies a move of black at an empty point by the patterns through
+/// it, writing the axes of its open threes to `threes` as a bit mask,
+/// in the order of `AXES`.
+///
+/// A five is never forbidden, in which case `threes` is empty. Whether
+/// two open threes make a double three is left to the caller, as only
+/// real threes count.
+template <usize N>
+Foul classify_foul(const BasicBoard<N> &board, Point p, u32 &threes) {
+    usize windows[4];
+    for (Axis axis : AXES)
+        windows[usize(axis)] =
+            exact_pattern_window(board, p, Stone::Black, axis);
+
+    threes = 0;
+    bool overline = false;
+    u32 fours = 0;
+    for (u32 i = 0; i < 4; i++) {
+        Pattern pattern = EXACT_PATTERN_TABLE[windows[i]];
+        if (pattern == Pattern::Five) {
+            threes = 0;
+            return Foul::None;
+        }
+        overline |= pattern == Pattern::Overline;
+        fours += count_fours(windows[i]);
+        if (pattern == Pattern::OpenThree)
+            threes |= 1 << i;
+    }
+    if (overline)
+        return Foul::Overline;
+    if (fours >= 2) {
+        threes = 0;
+        return Foul::DoubleFour;
+    }
+    return Foul::None;
+}
+
+template <usize N>
+Foul resolve_threes(BasicBoard<N> &board, Point p, u32 threes, u32 depth);
+
+/// Checks if black, having moved at the point, has a real three on the
+/// axis, namely an open three that makes a straight four with a move
+/// that is not itself forbidden.
+template <usize N>
+bool is_real_three(BasicBoard<N> &board, Point p, Axis axis, u32 depth) {
+    auto [line, bit] = line_pos<N>(p, axis);
+    for (i32 d = -i32(PATTERN_REACH); d <= i32(PATTERN_REACH); d++) {
+        i32 b = i32(bit) + d;
+        if (d == 0 || b < 0 || b >= i32(Geometry<N>::LINE_BITS) ||
+            !(BasicBoard<N>::LINE_MASKS[line] >> b & 1))
+            continue;
+        Point q = line_point<N>(axis, {line, u32(b)});
+        if (board.at(q) != Stone::None)
+            continue;
+
+        usize window = exact_pattern_window(board, q, Stone::Black, axis);
+        if (EXACT_PATTERN_TABLE[window] != Pattern::OpenFour ||
+            count_fours(window) != 1)
+            continue;
+        u32 threes;
+        if (classify_foul(board, q, threes) == Foul::None &&
+            (std::popcount(threes) < 2 ||
+             resolve_threes(board, q, threes, depth + 1) == Foul::None))
+            return true;
+    }
+    return false;
+}
+
+/// Decides if the open threes of a move of black at an empty point,
+/// given as a bit mask of axes, make a double three.
+template <usize N>
+Foul resolve_threes(BasicBoard<N> &board, Point p, u32 threes, u32 depth) {
+    if (depth >= FOUL_DEPTH)
+        return Foul::DoubleThree;
+
+    board.set(p, Stone::Black);
+    u32 real = 0;
+    for (Axis axis : AXES) {
+        if (threes >> usize(axis) & 1 && is_real_three(board, p, axis, depth))
+            real++;
+    }
+    board.unset(p);
+    return real >= 2 ? Foul::DoubleThree : Foul::None;
+}
+
+/// Checks cheaply if a move of black at an empty point may be forbidden,
+/// by counting the black stones within the pattern reach on each axis.
+///
+/// An overline or two fours on one line take four other stones on the
+/// line, and any other foul takes two or more on each of two lines.
+template <usize N> bool may_be_foul(const BasicBoard<N> &board, Point p) {
+    const u32 width_mask = (1 << (PATTERN_CELLS + 1)) - 1;
+    int most = 0, crowded = 0;
+    for (Axis axis : AXES) {
+        auto [line, bit] = line_pos<N>(p, axis);
+        u64 own = u64(board.line(Stone::Black, line)) << PATTERN_REACH >> bit;
+        int n = std::popcount(own & width_mask);
+        most = std::max(most, n);
+        crowded += n >= 2;
+    }
+    return most >= 4 || crowded >= 2;
+}
+
+/// Checks if a move of black at an empty point is forbidden under renju.
+///
+/// Most points are ruled out by `may_be_foul` and the others are mostly
+/// settled by four lookups in the pattern table. Only a point with two
+/// or more open threes needs a copy of the board, on which the moves
+/// that would make the threes straight fours are tried in turn.
+template <usize N> Foul renju_foul(const BasicBoard<N> &board, Point p) {
+    if (!may_be_foul(board, p))
+        return Foul::None;
+    u32 threes;
+    Foul foul = classify_foul(board, p, threes);
+    if (foul != Foul::None || std::popcount(threes) < 2)
+        return foul;
+    BasicBoard<N> scratch = board;
+    return resolve_threes(scratch, p, threes, 0);
+}
+
+/// Checks if a move of the stone at a point is legal under the rule.
+template <usize N>
+bool is_legal(const BasicBoard<N> &board, Point p, Stone stone, Rule rule) {
+    if (board.at(p) != Stone::None)
+        return false;
+    return rule != Rule::Renju || stone != Stone::Black ||
+           renju_foul(board, p) == Foul::None;
+}
+
+/// A map of the points forbidden to black under renju, kept in sync
+/// with a board incrementally.
+///
+/// The patterns through a point only change with the points on its
+/// lines within `EXACT_PATTERN_REACH`, so when the board changes by a few
+/// moves, only the points around them are classified again, and the
+/// whole map is rebuilt otherwise. Whether the open threes of a point
+/// are real depends on further points by recursion, so the points with
+/// two or more open threes, which are few, are kept in a bitset and
+/// decided again on every change.
+template <usize N> class BasicFoulMap {
+    typedef typename Geometry<N>::Line Line;
+
+    BasicBoard<N> board;
+    std::array<Foul, N * N> fouls{};
+    BasicBoardMask<N> contested{};
+
+    /// Maximum number of changed points to update incrementally.
+    static const usize INCREMENTAL_LIMIT = 4;
+
+    void check(Point p) {
+        Foul foul = Foul::None;
+        u32 threes = 0;
+        if (board.at(p) == Stone::None && may_be_foul(board, p)) {
+            foul = classify_foul(board, p, threes);
+            if (foul == Foul::None && std::popcount(threes) >= 2)
+                foul = resolve_threes(board, p, threes, 0);
+        }
+        fouls[p.y * N + p.x] = foul;
+        if (std::popcount(threes) >= 2)
+            contested[p.y] |= Line(1) << p.x;
+        else
+            contested[p.y] &= ~(Line(1) << p.x);
+    }
+
+    void check_around(Point p) {
+        check(p);
+        for (Axis axis : AXES) {
+            auto [line, bit] = line_pos<N>(p, axis);
+            const i32 reach = EXACT_PATTERN_REACH;
+            for (i32 d = -reach; d <= reach; d++) {
+                i32 b = i32(bit) + d;
+                if (d != 0 && b >= 0 && b < i32(Geometry<N>::LINE_BITS) &&
+                    BasicBoard<N>::LINE_MASKS[line] >> b & 1)
+                    check(line_point<N>(axis, {line, u32(b)}));
+            }
+        }
+    }
+
+  public:
+    /// Returns the foul of black at a point.
+    Foul at(Point p) const { return fouls[p.y * N + p.x]; }
+
+    /// Brings the map in sync with a board.
+    void sync(const BasicBoard<N> &target) {
+        // Find the points that differ by the horizontal lines.
+        Point changed[INCREMENTAL_LIMIT];
+        usize n = 0;
+        usize offset = Geometry<N>::AXIS_LINE_OFFSETS[usize(Axis::Horizontal)];
+        for (u32 y = 0; y < N && n <= INCREMENTAL_LIMIT; y++) {
+            Line diff = 0;
+            for (Stone stone : {Stone::Black, Stone::White})
+                diff |= board.line(stone, offset + y) ^
+                        target.line(stone, offset + y);
+            for (; diff != 0 && n <= INCREMENTAL_LIMIT; diff &= diff - 1) {
+                if (n < INCREMENTAL_LIMIT)
+                    changed[n] = Point(std::countr_zero(diff), y);
+                n++;
+            }
+        }
+        if (n == 0)
+            return;
+
+        board = target;
+        if (n > INCREMENTAL_LIMIT) {
+            for (u32 y = 0; y < N; y++) {
+                for (u32 x = 0; x < N; x++)
+                    check(Point(x, y));
+            }
+            return;
+        }
+        for (usize i = 0; i < n; i++)
+            check_around(changed[i]);
+        BasicBoardMask<N> pending = contested;
+        for_each_point(pending, [&](Point p) { check(p); });
+    }
+};
+
+/// The map of the points forbidden to black on the standard board.
+typedef BasicFoulMap<BOARD_SIZE> FoulMap;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "core.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GOMOKU_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define GOMOKU_TARGET_AVX2
+#else
+#define GOMOKU_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GOMOKU_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef GOMOKU_SIMD_X86
+
+/// Checks if the CPU and the OS support AVX2.
+bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = info[2] & (1 << 27);
+    __cpuidex(info, 7, 0);
+    bool avx2 = info[1] & (1 << 5);
+    return osxsave && avx2 && (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
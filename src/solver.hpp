@@ -0,0 +1,276 @@
+#pragma once
+
+#include <atomic>
+
+#include "core.hpp"
+#include "pattern.hpp"
+#include "rules.hpp"
+#include "tt.hpp"
+
+/// Kinds of forcing moves that a solver may play.
+enum struct SolveMode {
+    /// Victory by continuous fours.
+    Vcf,
+    /// Victory by continuous threes, or fours.
+    Vct,
+};
+
+/// Limits on a solve. Zero means no limit on nodes.
+struct SolveLimits {
+    /// Maximum number of attacking moves in a winning line.
+    u32 depth = 16;
+    u64 nodes = 100'000;
+    /// A flag that stops the solve once set, if not null.
+    const std::atomic<bool> *cancel = nullptr;
+};
+
+/// The result of a solve.
+struct SolveResult {
+    /// Whether the attacker has a forced win.
+    bool win = false;
+    /// The winning line, with attacking and defending moves in turn,
+    /// starting with an attacking move. Only the first defence tried
+    /// at each step is shown.
+    vector<Point> line;
+    /// The number of nodes searched.
+    u64 nodes = 0;
+
+    /// Returns the number of attacking moves in the winning line.
+    usize length() const { return (line.size() + 1) / 2; }
+};
+
+/// Returns the pattern through a point along the axis, as if the point
+/// were occupied by the stone, under the rule.
+///
+/// Where the rule requires exactly five, the wider windows tell fives
+/// from overlines, and an overline, which neither wins nor threatens,
+/// counts as no pattern.
+Pattern axis_pattern(const Board &board, Point p, Stone stone, Axis axis,
+                     Rule rule) {
+    if (!exact_five(rule, stone))
+        return PATTERN_TABLE[pattern_window(board, p, stone, axis)];
+    Pattern pattern =
+        EXACT_PATTERN_TABLE[exact_pattern_window(board, p, stone, axis)];
+    return pattern == Pattern::Overline ? Pattern::None : pattern;
+}
+
+/// Returns the strongest pattern through a point along any axis,
+/// as if the point were occupied by the stone, under the rule.
+Pattern best_pattern(const Board &board, Point p, Stone stone, Rule rule) {
+    Pattern best = Pattern::None;
+    for (Axis axis : AXES)
+        best = std::max(best, axis_pattern(board, p, stone, axis, rule));
+    return best;
+}
+
+/// Returns the bitset of points where the stone would make a five that
+/// wins under the rule.
+///
+/// Such points are always next to a stone, so only the candidate
+/// points are scanned. A five is never forbidden, so all of them are
+/// legal.
+BoardMask five_points(const Board &board, Stone stone, Rule rule) {
+    BoardMask fives{};
+    for_each_point(board.candidates(), [&](Point p) {
+        if (best_pattern(board, p, stone, rule) == Pattern::Five)
+            fives[p.y] |= u16(1) << p.x;
+    });
+    return fives;
+}
+
+/// Returns the number of points in a bitset.
+usize count_points(const BoardMask &mask) {
+    usize n = 0;
+    for (u16 row : mask)
+        n += std::popcount(row);
+    return n;
+}
+
+/// A threat-space solver for forced wins.
+///
+/// The solver searches only forcing moves: the attacker plays fours
+/// (and open threes in VCT mode), and the defender only answers with
+/// the moves that meet the threat, namely the points on the threat
+/// line within the pattern window, or counter-fours. Failed positions
+/// are memoised in a table of its own, by hash and remaining depth.
+///
+/// Fives are those that win under the rule, and moves of either side
+/// that are illegal under it are never played. A defender left without
+/// any legal reply to a threat, as black may be under renju, counts as
+/// lost.
+class Solver {
+    struct Entry {
+        u64 key = 0;
+        u32 depth = 0;
+    };
+
+    static const usize TABLE_SIZE = 1 << 16;
+
+    vector<Entry> table = vector<Entry>(TABLE_SIZE);
+    Board board;
+    Stone attacker;
+    SolveMode mode;
+    Rule rule;
+    u64 nodes;
+    u64 node_limit;
+    const std::atomic<bool> *cancel;
+
+    u64 key() const {
+        u64 side = attacker == Stone::White ? WHITE_TO_PLAY_KEY : 0;
+        return board.hash() ^ side;
+    }
+
+    /// Checks if a pattern is forcing enough for the attacker to play.
+    bool forcing(Pattern p) const {
+        if (mode == SolveMode::Vcf)
+            return p >= Pattern::Four;
+        return p >= Pattern::OpenThree;
+    }
+
+    bool exhausted() const {
+        return (node_limit != 0 && nodes >= node_limit) || (cancel && *cancel);
+    }
+
+    /// Searches with the attacker to play, returning whether it has a
+    /// forced win within `depth` attacking moves.
+    bool attack(u32 depth, vector<Point> &line) {
+        nodes++;
+        Stone defender = opposite(attacker);
+
+        optional<Point> five;
+        for_each_point(five_points(board, attacker, rule),
+                       [&](Point p) { five = p; });
+        if (five) {
+            line.assign(1, *five);
+            return true;
+        }
+        if (depth == 0 || exhausted())
+            return false;
+
+        Entry &entry = table[key() & (TABLE_SIZE - 1)];
+        if (entry.key == key() && entry.depth >= depth)
+            return false;
+
+        // A threat of five must be blocked first.
+        BoardMask blocks = five_points(board, defender, rule);
+        usize n_blocks = count_points(blocks);
+        if (n_blocks >= 2)
+            return false;
+        BoardMask moves = n_blocks == 1 ? blocks : board.candidates();
+
+        // Try the strongest threats first.
+        vector<pair<Pattern, Point>> threats;
+        for_each_point(moves, [&](Point p) {
+            Pattern pattern = best_pattern(board, p, attacker, rule);
+            if (forcing(pattern) && is_legal(board, p, attacker, rule))
+                threats.push_back({pattern, p});
+        });
+        std::stable_sort(threats.begin(), threats.end(),
+                         [](auto a, auto b) { return a.first > b.first; });
+
+        for (auto [pattern, p] : threats) {
+            board.set(p, attacker);
+            bool win = defend(p, depth - 1, line);
+            board.unset(p);
+            if (win) {
+                line.insert(line.begin(), p);
+                return true;
+            }
+            if (exhausted())
+                return false;
+        }
+
+        entry = {key(), depth};
+        return false;
+    }
+
+    /// Searches with the defender to play, after the attacker has
+    /// played at `last`.
+    bool defend(Point last, u32 depth, vector<Point> &line) {
+        nodes++;
+        Stone defender = opposite(attacker);
+        line.clear();
+
+        // The defender wins first with a five of its own.
+        if (count_points(five_points(board, defender, rule)) != 0)
+            return false;
+
+        BoardMask replies = five_points(board, attacker, rule);
+        usize n_fives = count_points(replies);
+        if (n_fives >= 2) {
+            // No single block stops both fives.
+            for_each_point(replies, [&](Point p) { line.push_back(p); });
+            line.resize(2);
+            return true;
+        }
+
+        if (n_fives == 0) {
+            // Meet the three on its line, or counter with a four.
+            for (Axis axis : AXES) {
+                if (axis_pattern(board, last, attacker, axis, rule) <
+                    Pattern::OpenThree)
+                    continue;
+                auto [index, bit] = line_pos(last, axis);
+                u16 empty = board.line_of(Stone::None, index);
+                for (u32 b = bit >= PATTERN_REACH ? bit - PATTERN_REACH : 0;
+                     b <= bit + PATTERN_REACH && b < 16; b++) {
+                    if (empty >> b & 1) {
+                        Point p = line_point(axis, {index, b});
+                        replies[p.y] |= u16(1) << p.x;
+                    }
+                }
+            }
+            for_each_point(board.candidates(), [&](Point p) {
+                if (best_pattern(board, p, defender, rule) >= Pattern::Four)
+                    replies[p.y] |= u16(1) << p.x;
+            });
+        }
+
+        bool first = true, win = true;
+        vector<Point> rest;
+        for_each_point(replies, [&](Point p) {
+            if (!win || !is_legal(board, p, defender, rule))
+                return;
+            board.set(p, defender);
+            rest.clear();
+            win = attack(depth, rest);
+            board.unset(p);
+            if (win && first) {
+                line.assign(1, p);
+                line.insert(line.end(), rest.begin(), rest.end());
+                first = false;
+            }
+        });
+        if (!win)
+            line.clear();
+        return win;
+    }
+
+  public:
+    /// Solves for a forced win of the attacker, who is to play, under
+    /// the rule.
+    SolveResult solve(const Board &position, Stone stone, SolveMode solve_mode,
+                      const SolveLimits &limits,
+                      Rule solve_rule = Rule::Freestyle) {
+        board = position;
+        attacker = stone;
+        mode = solve_mode;
+        rule = solve_rule;
+        nodes = 0;
+        node_limit = limits.nodes;
+        cancel = limits.cancel;
+        std::fill(table.begin(), table.end(), Entry());
+
+        // Deepen gradually, so that the shortest win is found first.
+        SolveResult result;
+        for (u32 depth = 1; depth <= limits.depth && !exhausted(); depth++) {
+            if (attack(depth, result.line)) {
+                result.win = true;
+                break;
+            }
+            result.line.clear();
+        }
+        result.nodes = nodes;
+        return result;
+    }
+};
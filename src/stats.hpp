@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+
+#include "core.hpp"
+
+/// Whether search statistics are counted. Defining `GOMOKU_NO_STATS`
+/// compiles the counting out, leaving all statistics zero.
+#ifdef GOMOKU_NO_STATS
+const bool STATS_ENABLED = false;
+#else
+const bool STATS_ENABLED = true;
+#endif
+
+/// A statistic counted during a search.
+enum struct Stat : u8 {
+    /// Nodes searched.
+    Nodes,
+    /// Nodes at the horizon, which are evaluated statically.
+    Leaves,
+    /// Probes of the transposition table, and those that found an entry.
+    TtProbes,
+    TtHits,
+    /// Nodes cut off by a move, and those cut off by the first move.
+    Cutoffs,
+    FirstMoveCutoffs,
+};
+
+/// Number of statistics in `Stat`.
+const usize STAT_COUNT = 6;
+
+/// Statistics of a search, summed over the threads.
+struct SearchStats {
+    std::array<u64, STAT_COUNT> counts{};
+
+    u64 operator[](Stat stat) const { return counts[usize(stat)]; }
+
+    SearchStats &operator+=(const SearchStats &other) {
+        for (usize i = 0; i < STAT_COUNT; i++)
+            counts[i] += other.counts[i];
+        return *this;
+    }
+
+    /// Returns the ratio of one statistic to another, or zero if the
+    /// latter is zero.
+    double ratio(Stat num, Stat den) const {
+        u64 d = (*this)[den];
+        return d == 0 ? 0.0 : double((*this)[num]) / double(d);
+    }
+};
+
+/// The counters of the statistics of one search thread.
+///
+/// Only the owning thread writes the counters, with a relaxed load and
+/// store rather than a read-modify-write, so that counting costs about
+/// as much as on plain integers, while other threads may read them at
+/// any time to aggregate the statistics.
+class StatCounters {
+    std::array<std::atomic<u64>, STAT_COUNT> counts{};
+
+  public:
+    /// Adds to a statistic. This must only be called by the owning
+    /// thread.
+    void add(Stat stat, u64 n = 1) {
+        if constexpr (STATS_ENABLED) {
+            std::atomic<u64> &count = counts[usize(stat)];
+            count.store(count.load(std::memory_order_relaxed) + n,
+                        std::memory_order_relaxed);
+        }
+    }
+
+    /// Returns a snapshot of the statistics.
+    SearchStats snapshot() const {
+        SearchStats stats;
+        if constexpr (STATS_ENABLED) {
+            for (usize i = 0; i < STAT_COUNT; i++)
+                stats.counts[i] = counts[i].load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+};
@@ -0,0 +1,194 @@
+#include <QtCore>
+
+#include <cstdio>
+#include <cstring>
+
+#include "core.hpp"
+#include "eval.hpp"
+#include "fixtures.hpp"
+#include "nnue.hpp"
+
+/// Number of random boards each evaluation kernel is tested on.
+const usize RANDOM_BOARDS = 20'000;
+
+/// Number of random accumulators each network kernel is tested on.
+const usize RANDOM_ACCUMULATORS = 20'000;
+
+/// Maximum number of mismatches reported for each kernel.
+const usize REPORTED_MISMATCHES = 5;
+
+/// A kernel under test, with the number of mismatches found so far.
+template <class Kernel> struct TestedKernel {
+    const char *name;
+    Kernel kernel;
+    usize mismatches = 0;
+
+    /// Records a mismatch, reporting it if it is among the first ones.
+    template <class... Args> void mismatch(const char *format, Args... args) {
+        if (mismatches++ < REPORTED_MISMATCHES) {
+            std::fprintf(stderr, "gomoku-test: %s: ", name);
+            std::fprintf(stderr, format, args...);
+            std::fputc('\n', stderr);
+        }
+    }
+};
+
+/// Returns the vectorised evaluation kernels supported at run time.
+vector<TestedKernel<EvalKernel>> eval_kernels() {
+    vector<TestedKernel<EvalKernel>> kernels;
+#if defined(GOMOKU_SIMD_X86)
+    kernels.push_back({"evaluate_sse2", evaluate_sse2});
+    if (cpu_has_avx2())
+        kernels.push_back({"evaluate_avx2", evaluate_avx2});
+#elif defined(GOMOKU_SIMD_NEON)
+    kernels.push_back({"evaluate_neon", evaluate_neon});
+#endif
+    return kernels;
+}
+
+/// Returns the vectorised network kernels supported at run time.
+vector<TestedKernel<NnueKernels>> nnue_kernels() {
+    vector<TestedKernel<NnueKernels>> kernels;
+#if defined(GOMOKU_SIMD_X86)
+    kernels.push_back(
+        {"nnue_sse2", {nnue_add_sse2, nnue_sub_sse2, nnue_output_sse2}});
+    if (cpu_has_avx2())
+        kernels.push_back(
+            {"nnue_avx2", {nnue_add_avx2, nnue_sub_avx2, nnue_output_avx2}});
+#elif defined(GOMOKU_SIMD_NEON)
+    kernels.push_back(
+        {"nnue_neon", {nnue_add_neon, nnue_sub_neon, nnue_output_neon}});
+#endif
+    return kernels;
+}
+
+/// Returns a board with stones of either colour at random points, as
+/// many as drawn from `[0, BOARD_SIZE * BOARD_SIZE]`, so that boards
+/// from empty to full are all tested.
+Board random_board(u64 &seed) {
+    Board board;
+    usize stones = splitmix64(seed) % (BOARD_SIZE * BOARD_SIZE + 1);
+    for (usize i = 0; i < stones; i++) {
+        u64 r = splitmix64(seed);
+        Point p(r % BOARD_SIZE, r / BOARD_SIZE % BOARD_SIZE);
+        board.set(p, r >> 32 & 1 ? Stone::White : Stone::Black);
+    }
+    return board;
+}
+
+/// Tests the evaluation kernels against `evaluate_scalar` on a board,
+/// from the perspectives of both stones.
+void test_eval(vector<TestedKernel<EvalKernel>> &kernels, const Board &board,
+               const char *source) {
+    for (Stone stone : {Stone::Black, Stone::White}) {
+        i32 expected = evaluate_scalar(board, stone);
+        for (auto &k : kernels) {
+            i32 actual = k.kernel(board, stone);
+            if (actual != expected)
+                k.mismatch("%s: got %d, expected %d", source, actual,
+                           expected);
+        }
+    }
+}
+
+/// Fills an accumulator with random values, either over the whole range
+/// or, more often, around the range of activations, so that both the
+/// wrapping sums and the clipping are tested.
+void random_values(i16 *values, u64 &seed) {
+    bool wide = splitmix64(seed) % 4 == 0;
+    for (usize i = 0; i < NNUE_HIDDEN; i++) {
+        u64 r = splitmix64(seed);
+        values[i] = wide ? i16(r) : i16(i32(r % 512) - 192);
+    }
+}
+
+/// Tests the network kernels against their scalar references on random
+/// accumulators, columns and output weights.
+///
+/// The columns are read at an odd offset, as those of a mapped file may
+/// not be aligned.
+void test_nnue(vector<TestedKernel<NnueKernels>> &kernels, u64 &seed) {
+    Accumulator acc, expected, actual;
+    i16 column_buf[NNUE_HIDDEN + 1];
+    i8 weights[NNUE_HIDDEN];
+    const i16 *column = column_buf + 1;
+
+    for (usize n = 0; n < RANDOM_ACCUMULATORS; n++) {
+        random_values(acc.values[0], seed);
+        random_values(column_buf, seed);
+        column_buf[NNUE_HIDDEN] = i16(splitmix64(seed));
+        for (i8 &w : weights)
+            w = i8(splitmix64(seed));
+
+        i32 output = nnue_output_scalar(acc.values[0], weights);
+        std::memcpy(expected.values[0], acc.values[0], sizeof acc.values[0]);
+        nnue_add_scalar(expected.values[0], column);
+        std::memcpy(expected.values[1], acc.values[0], sizeof acc.values[0]);
+        nnue_sub_scalar(expected.values[1], column);
+
+        for (auto &k : kernels) {
+            i32 got = k.kernel.output(acc.values[0], weights);
+            if (got != output)
+                k.mismatch("output #%zu: got %d, expected %d", n, got,
+                           output);
+
+            std::memcpy(actual.values[0], acc.values[0], sizeof acc.values[0]);
+            k.kernel.add(actual.values[0], column);
+            if (std::memcmp(actual.values[0], expected.values[0],
+                            sizeof acc.values[0]) != 0)
+                k.mismatch("add #%zu differs", n);
+
+            std::memcpy(actual.values[1], acc.values[0], sizeof acc.values[0]);
+            k.kernel.sub(actual.values[1], column);
+            if (std::memcmp(actual.values[1], expected.values[1],
+                            sizeof acc.values[0]) != 0)
+                k.mismatch("sub #%zu differs", n);
+        }
+    }
+}
+
+/// Reports the result of the kernels tested, returning whether all of
+/// them agree with the references.
+template <class Kernel>
+bool report(const vector<TestedKernel<Kernel>> &kernels, usize cases) {
+    bool ok = true;
+    for (const auto &k : kernels) {
+        std::printf("%s: %zu mismatches in %zu cases\n", k.name,
+                    k.mismatches, cases);
+        ok &= k.mismatches == 0;
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    QString path = argc > 1 ? QString(argv[1]) : QString(GOMOKU_FIXTURES);
+    auto fixtures = load_fixtures(path);
+    if (!fixtures) {
+        std::fprintf(stderr, "gomoku-test: cannot load games from %s\n",
+                     qPrintable(path));
+        return 1;
+    }
+
+    // Every position along the notable games, and then random boards.
+    auto evals = eval_kernels();
+    usize boards = 0;
+    for (Fixture &fixture : *fixtures) {
+        Game &game = fixture.game;
+        for (usize i = 0; i <= game.total_moves(); i++, boards++) {
+            game.jump(i);
+            test_eval(evals, game.position(), fixture.name.c_str());
+        }
+    }
+    u64 seed = 0;
+    for (usize i = 0; i < RANDOM_BOARDS; i++, boards++)
+        test_eval(evals, random_board(seed), "random board");
+
+    auto nnues = nnue_kernels();
+    test_nnue(nnues, seed);
+
+    if (evals.empty() && nnues.empty())
+        std::printf("no vectorised kernels supported\n");
+    bool ok = report(evals, boards * 2);
+    ok &= report(nnues, RANDOM_ACCUMULATORS * 3);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include "core.hpp"
+
+/// The magic bytes at the start of a move trie.
+const char TRIE_MAGIC[8] = {'G', 'O', 'M', 'O', 'K', 'U', 'T', 'R'};
+
+/// The version of the trie format.
+const u32 TRIE_VERSION = 1;
+
+/// The suffix appended to the path of a game database to give the
+/// path of its move trie.
+const char TRIE_SUFFIX[] = ".trie";
+
+/// Size of the trie header, in bytes.
+///
+/// The header consists of the magic bytes, the format version (`u32`),
+/// the board size (`u32`) and the number of nodes (`u64`), in order.
+/// All integers in a trie are little-endian.
+const usize TRIE_HEADER_SIZE = 24;
+
+/// Size of a trie node, in bytes.
+///
+/// The nodes follow the header in breadth-first order, starting with
+/// the root, so that the children of each node are contiguous. Each
+/// node holds the label of the move leading to it (`u16`), the number
+/// of its children (`u16`), the index of its first child (`u32`) and
+/// the number of games passing through it (`u32`). Children are sorted
+/// by label, which is the stone in the high byte and the position as
+/// `y * BOARD_SIZE + x` in the low byte.
+const usize TRIE_NODE_SIZE = 12;
+
+/// Returns the label of a move in a trie.
+constexpr u16 trie_label(Move move) {
+    return u16(usize(move.stone) << 8 | (move.pos.y * BOARD_SIZE + move.pos.x));
+}
+
+/// Returns the move with a label in a trie.
+constexpr Move trie_move(u16 label) {
+    u8 pos = label & 0xff;
+    return {{u32(pos % BOARD_SIZE), u32(pos / BOARD_SIZE)}, Stone(label >> 8)};
+}
+
+/// A read-only prefix trie over the move sequences of games in a
+/// database, memory-mapped from a file.
+///
+/// A query walks down from the root along the moves of a prefix, with
+/// a binary search among the children at each step, and touches only
+/// the nodes on the way.
+class MoveTrie {
+    std::unique_ptr<QFile> file;
+    const u8 *nodes = nullptr;
+    usize count = 0;
+
+    const u8 *node(u32 i) const { return nodes + usize(i) * TRIE_NODE_SIZE; }
+    u16 label(u32 i) const { return qFromLittleEndian<u16>(node(i)); }
+    u16 child_count(u32 i) const { return qFromLittleEndian<u16>(node(i) + 2); }
+    u32 first_child(u32 i) const {
+        return qFromLittleEndian<u32>(node(i) + 4);
+    }
+
+  public:
+    /// Opens and maps a trie file, returning `nullopt` if the file
+    /// cannot be mapped or is not a valid trie.
+    static optional<MoveTrie> open(const QString &path) {
+        MoveTrie trie;
+        trie.file = std::make_unique<QFile>(path);
+        if (!trie.file->open(QIODevice::ReadOnly))
+            return nullopt;
+
+        u64 size = trie.file->size();
+        if (size < TRIE_HEADER_SIZE + TRIE_NODE_SIZE)
+            return nullopt;
+        const u8 *base = trie.file->map(0, size);
+        if (!base)
+            return nullopt;
+
+        u64 count = qFromLittleEndian<u64>(base + 16);
+        if (std::memcmp(base, TRIE_MAGIC, sizeof TRIE_MAGIC) != 0 ||
+            qFromLittleEndian<u32>(base + 8) != TRIE_VERSION ||
+            qFromLittleEndian<u32>(base + 12) != BOARD_SIZE || count == 0 ||
+            count > UINT32_MAX ||
+            count != (size - TRIE_HEADER_SIZE) / TRIE_NODE_SIZE)
+            return nullopt;
+
+        trie.nodes = base + TRIE_HEADER_SIZE;
+        trie.count = count;
+
+        // Check that the children are within the nodes, so that queries
+        // need no checks of their own.
+        for (u32 i = 0; i < count; i++) {
+            u64 end = u64(trie.first_child(i)) + trie.child_count(i);
+            if (trie.child_count(i) != 0 &&
+                (trie.first_child(i) <= i || end > count))
+                return nullopt;
+        }
+        return trie;
+    }
+
+    /// Returns the index of the root node, namely the empty prefix.
+    u32 root() const { return 0; }
+
+    /// Returns the index of the node reached from the root along the
+    /// moves, or `nullopt` if no game starts with them.
+    optional<u32> find(span<const Move> prefix) const {
+        u32 i = root();
+        for (Move move : prefix) {
+            auto child = find_child(i, move);
+            if (!child)
+                return nullopt;
+            i = *child;
+        }
+        return i;
+    }
+
+    /// Returns the index of the child of a node along a move, if any.
+    optional<u32> find_child(u32 i, Move move) const {
+        u16 target = trie_label(move);
+        u32 lo = first_child(i), hi = lo + child_count(i);
+        while (lo < hi) {
+            u32 mid = lo + (hi - lo) / 2;
+            if (label(mid) < target)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < first_child(i) + child_count(i) && label(lo) == target)
+            return lo;
+        return nullopt;
+    }
+
+    /// Returns the number of games passing through a node.
+    u32 games(u32 i) const { return qFromLittleEndian<u32>(node(i) + 8); }
+
+    /// Calls `f(move, games)` for each child of a node, in order of
+    /// label, with the move leading to the child and the number of
+    /// games passing through it.
+    template <class F> void for_each_child(u32 i, F &&f) const {
+        u32 first = first_child(i);
+        for (u32 c = first; c < first + child_count(i); c++)
+            f(trie_move(label(c)), games(c));
+    }
+};
+
+/// A builder of move tries.
+///
+/// Sequences are inserted into a trie in memory, where the children of
+/// each node form a linked list in an arena, and are laid out in
+/// breadth-first order with sorted children when written.
+class MoveTrieBuilder {
+    struct Node {
+        u16 label;
+        u32 games = 0;
+        u32 first_child = 0;
+        u32 next_sibling = 0;
+    };
+
+    // Index 0 is the root, so that 0 can mark the end of a list.
+    vector<Node> arena{Node{0}};
+    usize max_depth;
+
+  public:
+    /// Creates a builder that keeps at most `max_depth` moves of each
+    /// sequence, or all if zero.
+    explicit MoveTrieBuilder(usize max_depth = 0) : max_depth(max_depth) {}
+
+    /// Inserts a move sequence.
+    void add(span<const Move> moves) {
+        if (max_depth != 0 && moves.size() > max_depth)
+            moves = moves.first(max_depth);
+
+        u32 i = 0;
+        arena[0].games++;
+        for (Move move : moves) {
+            u16 target = trie_label(move);
+            u32 c = arena[i].first_child;
+            while (c != 0 && arena[c].label != target)
+                c = arena[c].next_sibling;
+            if (c == 0) {
+                c = arena.size();
+                arena.push_back({target, 0, 0, arena[i].first_child});
+                arena[i].first_child = c;
+            }
+            arena[c].games++;
+            i = c;
+        }
+    }
+
+    /// Writes the trie to a file, returning whether it succeeded.
+    bool write(const QString &path) const {
+        QByteArray buf(TRIE_MAGIC, sizeof TRIE_MAGIC);
+        buf.reserve(TRIE_HEADER_SIZE + arena.size() * TRIE_NODE_SIZE);
+        auto append_le = [&](auto value) {
+            char bytes[sizeof value];
+            qToLittleEndian(value, bytes);
+            buf.append(bytes, sizeof value);
+        };
+        append_le(TRIE_VERSION);
+        append_le(u32(BOARD_SIZE));
+        append_le(u64(arena.size()));
+
+        // Lay out the nodes breadth-first, where `order` holds the
+        // arena indices in output order.
+        vector<u32> order{0}, children;
+        order.reserve(arena.size());
+        for (usize i = 0; i < order.size(); i++) {
+            const Node &node = arena[order[i]];
+            children.clear();
+            for (u32 c = node.first_child; c != 0; c = arena[c].next_sibling)
+                children.push_back(c);
+            std::sort(children.begin(), children.end(), [&](u32 a, u32 b) {
+                return arena[a].label < arena[b].label;
+            });
+
+            append_le(node.label);
+            append_le(u16(children.size()));
+            append_le(u32(children.empty() ? 0 : order.size()));
+            append_le(node.games);
+            order.insert(order.end(), children.begin(), children.end());
+        }
+
+        QSaveFile file(path);
+        return file.open(QIODevice::WriteOnly) &&
+               file.write(buf) == buf.size() && file.commit();
+    }
+};
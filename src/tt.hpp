@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "core.hpp"
+
+/// Key mixed into the Zobrist hash when white is to play.
+const u64 WHITE_TO_PLAY_KEY = 0x6a09e667f3bcc908;
+
+/// Bound of a score stored in a transposition table entry.
+enum struct Bound : u8 { None = 0, Upper = 1, Lower = 2, Exact = 3 };
+
+/// Marker of no move in a transposition table entry.
+const u8 NO_MOVE = 0xff;
+
+/// Data of a transposition table entry, unpacked.
+struct TTData {
+    /// The best move, as `y * BOARD_SIZE + x`, or `NO_MOVE`.
+    u8 move;
+    u8 depth;
+    Bound bound;
+    i32 score;
+
+    /// Returns the best move (if any).
+    optional<Point> best() const {
+        if (move == NO_MOVE)
+            return nullopt;
+        return Point(move % BOARD_SIZE, move / BOARD_SIZE);
+    }
+};
+
+/// A fixed-size transposition table shared by the search threads.
+///
+/// Each entry is 16 bytes, namely two 64-bit words written with relaxed
+/// atomic stores: the packed data, and the key XOR-ed with the data.
+/// A torn entry, with words from different writes, fails the key check
+/// on probing, so no locking is needed. Entries are grouped by 4 into
+/// buckets of one cache line each.
+class TranspositionTable {
+    struct Entry {
+        std::atomic<u64> check{0};
+        std::atomic<u64> data{0};
+    };
+
+    struct alignas(64) Bucket {
+        Entry entries[4];
+    };
+
+    static_assert(sizeof(Bucket) == 64);
+
+    static const u64 AGE_MASK = 0x3f;
+
+    std::unique_ptr<Bucket[]> buckets;
+    usize bucket_count = 0;
+    usize size_mb;
+    u64 age = 0;
+
+    static u64 pack(u8 move, u8 depth, Bound bound, u64 age, i32 score) {
+        return u64(move) | u64(depth) << 8 | u64(bound) << 16 | age << 18 |
+               u64(u32(score)) << 32;
+    }
+
+    static TTData unpack(u64 data) {
+        return {u8(data), u8(data >> 8), Bound((data >> 16) & 3),
+                i32(u32(data >> 32))};
+    }
+
+    static u64 age_of(u64 data) { return (data >> 18) & AGE_MASK; }
+
+    Bucket &bucket_of(u64 key) const {
+        return buckets[key & (bucket_count - 1)];
+    }
+
+  public:
+    /// Creates a table of the given size in MiB, rounded down to a power
+    /// of two. The memory is not allocated until the first search.
+    explicit TranspositionTable(usize size_mb) : size_mb(size_mb) {}
+
+    /// Returns the size of the table in MiB.
+    usize size() const { return size_mb; }
+
+    /// Resizes the table, clearing all entries.
+    void resize(usize new_size_mb) {
+        size_mb = new_size_mb;
+        buckets.reset();
+        bucket_count = 0;
+    }
+
+    /// Clears all entries.
+    void clear() {
+        buckets.reset();
+        bucket_count = 0;
+        age = 0;
+    }
+
+    /// Prepares the table for a new search, so that entries from
+    /// earlier searches are preferred for replacement.
+    ///
+    /// This must not be called while any thread is using the table.
+    void new_search() {
+        if (!buckets) {
+            usize bytes = std::max<usize>(size_mb, 1) << 20;
+            bucket_count = std::bit_floor(bytes / sizeof(Bucket));
+            buckets = std::make_unique<Bucket[]>(bucket_count);
+        }
+        age = (age + 1) & AGE_MASK;
+    }
+
+    /// Probes the table for an entry with the key.
+    optional<TTData> probe(u64 key) const {
+        for (Entry &e : bucket_of(key).entries) {
+            u64 data = e.data.load(std::memory_order_relaxed);
+            u64 check = e.check.load(std::memory_order_relaxed);
+            if ((check ^ data) == key && data != 0)
+                return unpack(data);
+        }
+        return nullopt;
+    }
+
+    /// Stores an entry with the key.
+    ///
+    /// An entry with the same key is replaced unless it is deeper and
+    /// the new score is not exact. Otherwise the entry replaced is the
+    /// shallowest one, counting entries from earlier searches as 8
+    /// plies shallower for each search since.
+    void store(u64 key, optional<Point> best, u32 depth, Bound bound,
+               i32 score) {
+        Bucket &bucket = bucket_of(key);
+        Entry *victim = nullptr;
+        i32 victim_worth = INT32_MAX;
+
+        for (Entry &e : bucket.entries) {
+            u64 data = e.data.load(std::memory_order_relaxed);
+            u64 check = e.check.load(std::memory_order_relaxed);
+            if ((check ^ data) == key && data != 0) {
+                TTData old = unpack(data);
+                if (old.depth > depth && bound != Bound::Exact &&
+                    age_of(data) == age)
+                    return;
+                // Keep the old move if no new one is known.
+                if (!best && old.move != NO_MOVE)
+                    best = old.best();
+                victim = &e;
+                break;
+            }
+            i32 stale = i32((age - age_of(data)) & AGE_MASK);
+            i32 worth = i32(u8(data >> 8)) - 8 * stale;
+            if (worth < victim_worth) {
+                victim = &e;
+                victim_worth = worth;
+            }
+        }
+
+        u8 move = best ? u8(best->y * BOARD_SIZE + best->x) : NO_MOVE;
+        u8 clamped = u8(std::min<u32>(depth, 0xff));
+        u64 data = pack(move, clamped, bound, age, score);
+        victim->check.store(key ^ data, std::memory_order_relaxed);
+        victim->data.store(data, std::memory_order_relaxed);
+    }
+};
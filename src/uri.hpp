@@ -0,0 +1,391 @@
+#pragma once
+
+#include <cstring>
+
+#include <QByteArray>
+
+#include "game.hpp"
+#include "simd.hpp"
+
+/// The prefix of a game URI.
+const char URI_PREFIX[] = "gomoku:";
+
+/// Length of the URI prefix.
+const usize URI_PREFIX_LEN = sizeof URI_PREFIX - 1;
+
+/// An error in decoding a game URI.
+enum struct UriError {
+    /// The URI does not start with `URI_PREFIX`.
+    MissingPrefix,
+    /// The URI does not end with `;`, which may mean that it was
+    /// only partially copied.
+    MissingTerminator,
+    /// The payload is not valid base64url.
+    InvalidBase64,
+    /// The payload is not a valid serialized game under the rule.
+    InvalidGame,
+};
+
+/// The base64url alphabet.
+const char BASE64URL_CHARS[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/// Values of base64url characters, or `0xff` for invalid ones.
+const auto BASE64URL_VALUES = [] {
+    std::array<u8, 256> values;
+    values.fill(0xff);
+    for (u8 i = 0; i < 64; i++)
+        values[u8(BASE64URL_CHARS[i])] = i;
+    return values;
+}();
+
+/// Returns the length of `n` bytes encoded in base64url, without padding.
+constexpr usize base64url_encoded_len(usize n) { return (n * 4 + 2) / 3; }
+
+/// Returns the length of `n` base64url characters decoded, without
+/// padding, or `nullopt` if no bytes encode to that many characters.
+constexpr optional<usize> base64url_decoded_len(usize n) {
+    if (n % 4 == 1)
+        return nullopt;
+    return n / 4 * 3 + (n % 4 == 0 ? 0 : n % 4 - 1);
+}
+
+/// Checks if a character is whitespace, as in `QByteArray::trimmed`.
+constexpr bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/// Encodes bytes in base64url without padding, one group of 3 bytes
+/// into 4 characters at a time, returning the number of bytes consumed.
+usize base64url_encode_scalar(span<const u8> in, char *out) {
+    usize i = 0;
+    for (; i + 3 <= in.size(); i += 3, out += 4) {
+        u32 v = u32(in[i]) << 16 | u32(in[i + 1]) << 8 | in[i + 2];
+        out[0] = BASE64URL_CHARS[v >> 18];
+        out[1] = BASE64URL_CHARS[v >> 12 & 63];
+        out[2] = BASE64URL_CHARS[v >> 6 & 63];
+        out[3] = BASE64URL_CHARS[v & 63];
+    }
+
+    usize rest = in.size() - i;
+    if (rest != 0) {
+        u32 v = u32(in[i]) << 16 | (rest == 2 ? u32(in[i + 1]) << 8 : 0);
+        out[0] = BASE64URL_CHARS[v >> 18];
+        out[1] = BASE64URL_CHARS[v >> 12 & 63];
+        if (rest == 2)
+            out[2] = BASE64URL_CHARS[v >> 6 & 63];
+    }
+    return in.size();
+}
+
+/// Decodes base64url without padding, whose length must be valid for
+/// `base64url_decoded_len`, returning whether all characters are valid.
+///
+/// As with `QByteArray::fromBase64`, the unused bits of the last
+/// character are ignored.
+bool base64url_decode_scalar(span<const char> in, u8 *out) {
+    u8 invalid = 0;
+    usize i = 0;
+    for (; i + 4 <= in.size(); i += 4, out += 3) {
+        u8 a = BASE64URL_VALUES[u8(in[i])], b = BASE64URL_VALUES[u8(in[i + 1])],
+           c = BASE64URL_VALUES[u8(in[i + 2])],
+           d = BASE64URL_VALUES[u8(in[i + 3])];
+        invalid |= a | b | c | d;
+        u32 v = u32(a) << 18 | u32(b) << 12 | u32(c) << 6 | d;
+        out[0] = u8(v >> 16);
+        out[1] = u8(v >> 8);
+        out[2] = u8(v);
+    }
+
+    usize rest = in.size() - i;
+    if (rest != 0) {
+        u8 a = BASE64URL_VALUES[u8(in[i])], b = BASE64URL_VALUES[u8(in[i + 1])];
+        u8 c = rest == 3 ? BASE64URL_VALUES[u8(in[i + 2])] : 0;
+        invalid |= a | b | c;
+        u32 v = u32(a) << 18 | u32(b) << 12 | u32(c) << 6;
+        out[0] = u8(v >> 16);
+        if (rest == 3)
+            out[1] = u8(v >> 8);
+    }
+    // Valid values are below 64, while the invalid marker is `0xff`.
+    return invalid < 64;
+}
+
+#ifdef GOMOKU_SIMD_X86
+
+/// Encodes bytes in base64url with AVX2, 24 bytes into 32 characters at
+/// a time, returning the number of bytes consumed. The rest is left to
+/// the scalar encoder.
+///
+/// The 12 bytes in each 128-bit lane are spread over 4 bytes per group,
+/// and the four 6-bit indices of each group are shifted into place with
+/// 16-bit multiplies, before being mapped to characters by range.
+GOMOKU_TARGET_AVX2 usize base64url_encode_avx2(span<const u8> in, char *out) {
+    const __m256i spread = _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, //
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+    usize i = 0;
+    // Each iteration loads 28 bytes, of which 24 are used.
+    for (; i + 28 <= in.size(); i += 24, out += 32) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in.data() + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in.data() + i + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, spread);
+
+        __m256i ac = _mm256_mulhi_epu16(
+            _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+            _mm256_set1_epi32(0x04000040));
+        __m256i bd = _mm256_mullo_epi16(
+            _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+            _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(ac, bd);
+
+        // 'A'..'Z', 'a'..'z', '0'..'9', '-' and '_' in turn.
+        __m256i offset = _mm256_set1_epi8('A');
+        offset = _mm256_blendv_epi8(
+            offset, _mm256_set1_epi8('a' - 26),
+            _mm256_cmpgt_epi8(idx, _mm256_set1_epi8(25)));
+        offset = _mm256_blendv_epi8(
+            offset, _mm256_set1_epi8('0' - 52),
+            _mm256_cmpgt_epi8(idx, _mm256_set1_epi8(51)));
+        offset = _mm256_blendv_epi8(
+            offset, _mm256_set1_epi8('-' - 62),
+            _mm256_cmpeq_epi8(idx, _mm256_set1_epi8(62)));
+        offset = _mm256_blendv_epi8(
+            offset, _mm256_set1_epi8('_' - 63),
+            _mm256_cmpeq_epi8(idx, _mm256_set1_epi8(63)));
+        _mm256_storeu_si256((__m256i *)out, _mm256_add_epi8(idx, offset));
+    }
+    return i + base64url_encode_scalar(in.subspan(i), out);
+}
+
+/// Returns the mask of bytes between `lo` and `hi` inclusive, as signed.
+GOMOKU_TARGET_AVX2 __m256i in_range_epi8(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+/// Decodes base64url with AVX2, 32 characters into 24 bytes at a time,
+/// returning whether all characters are valid. The rest is left to the
+/// scalar decoder.
+///
+/// Characters are validated and mapped to values by range in the same
+/// pass, and the values are packed with multiply-adds and shuffles.
+GOMOKU_TARGET_AVX2 bool base64url_decode_avx2(span<const char> in, u8 *out) {
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, //
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    __m256i valid = _mm256_set1_epi8(-1);
+    usize i = 0;
+    for (; i + 32 <= in.size(); i += 32, out += 24) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in.data() + i));
+
+        // Bytes beyond ASCII are negative and fall in no range.
+        __m256i upper = in_range_epi8(v, 'A', 'Z');
+        __m256i lower = in_range_epi8(v, 'a', 'z');
+        __m256i digit = in_range_epi8(v, '0', '9');
+        __m256i dash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'));
+        __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        valid = _mm256_and_si256(
+            valid, _mm256_or_si256(_mm256_or_si256(upper, lower),
+                                   _mm256_or_si256(_mm256_or_si256(digit, dash),
+                                                   underscore)));
+
+        __m256i offset = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+                _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+            _mm256_or_si256(
+                _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+                _mm256_or_si256(
+                    _mm256_and_si256(dash, _mm256_set1_epi8(62 - '-')),
+                    _mm256_and_si256(underscore, _mm256_set1_epi8(63 - '_')))));
+        v = _mm256_add_epi8(v, offset);
+
+        // Merge 4 values of 6 bits into 3 bytes in each group.
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        v = _mm256_permutevar8x32_epi32(
+            v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(v, 1));
+    }
+    return _mm256_movemask_epi8(valid) == -1 &&
+           base64url_decode_scalar(in.subspan(i), out);
+}
+
+/// Whether the AVX2 codec is supported at run time.
+const bool BASE64URL_AVX2 = cpu_has_avx2();
+
+#endif
+
+/// Encodes bytes in base64url without padding into `out`, which must
+/// have room for `base64url_encoded_len(in.size())` characters.
+void base64url_encode(span<const u8> in, char *out) {
+#ifdef GOMOKU_SIMD_X86
+    if (BASE64URL_AVX2) {
+        base64url_encode_avx2(in, out);
+        return;
+    }
+#endif
+    base64url_encode_scalar(in, out);
+}
+
+/// Decodes base64url without padding into `out`, which must have room
+/// for `base64url_decoded_len(in.size())` bytes, returning whether the
+/// input is valid.
+bool base64url_decode(span<const char> in, u8 *out) {
+    if (!base64url_decoded_len(in.size()))
+        return false;
+#ifdef GOMOKU_SIMD_X86
+    if (BASE64URL_AVX2)
+        return base64url_decode_avx2(in, out);
+#endif
+    return base64url_decode_scalar(in, out);
+}
+
+/// A codec of game URIs, in the form of `gomoku:<base64url>;`.
+///
+/// The codec keeps its scratch buffers across calls, so that encoding
+/// and decoding many URIs with the same codec does not allocate once
+/// the buffers have grown large enough.
+class UriCodec {
+    QByteArray bytes;
+    vector<u8> decoded;
+
+  public:
+    /// Encodes a game into a URI, appending it to `out`.
+    ///
+    /// Only the past moves are encoded, unless `tree` is set, in which
+    /// case the whole tree of variations is.
+    template <usize N>
+    void encode(const BasicGame<N> &game, QByteArray &out, bool tree = false) {
+        bytes.resize(0);
+        if (tree)
+            game.serialize_tree_into(bytes);
+        else
+            game.serialize_into(bytes);
+
+        usize start = out.size();
+        usize len = base64url_encoded_len(bytes.size());
+        out.resize(start + URI_PREFIX_LEN + len + 1);
+        char *p = out.data() + start;
+        std::memcpy(p, URI_PREFIX, URI_PREFIX_LEN);
+        base64url_encode({reinterpret_cast<const u8 *>(bytes.constData()),
+                          usize(bytes.size())},
+                         p + URI_PREFIX_LEN);
+        p[URI_PREFIX_LEN + len] = ';';
+    }
+
+    /// Decodes a URI into a reusable game, ignoring surrounding
+    /// whitespace, returning whether it succeeded.
+    ///
+    /// The prefix and the terminator are parsed in place, and the
+    /// payload is validated as it is decoded. On failure, the error is
+    /// written to `error` if it is not null.
+    template <usize N>
+    bool decode(span<const char> uri, BasicGame<N> &game,
+                UriError *error = nullptr) {
+        auto fail = [&](UriError e) {
+            if (error)
+                *error = e;
+            return false;
+        };
+
+        const char *begin = uri.data(), *end = begin + uri.size();
+        while (begin != end && is_space(*begin))
+            begin++;
+        while (begin != end && is_space(end[-1]))
+            end--;
+
+        usize len = end - begin;
+        if (len < URI_PREFIX_LEN ||
+            std::memcmp(begin, URI_PREFIX, URI_PREFIX_LEN) != 0)
+            return fail(UriError::MissingPrefix);
+        begin += URI_PREFIX_LEN;
+
+        if (begin == end || end[-1] != ';')
+            return fail(UriError::MissingTerminator);
+        end--;
+
+        // Accept the padding that other encoders may have added.
+        if ((end - begin) % 4 == 0) {
+            for (int i = 0; i < 2 && begin != end && end[-1] == '='; i++)
+                end--;
+        }
+
+        span<const char> payload(begin, end);
+        auto n = base64url_decoded_len(payload.size());
+        if (!n)
+            return fail(UriError::InvalidBase64);
+        decoded.resize(*n);
+        if (!base64url_decode(payload, decoded.data()))
+            return fail(UriError::InvalidBase64);
+
+        if (!BasicGame<N>::deserialize(decoded, game))
+            return fail(UriError::InvalidGame);
+        return true;
+    }
+
+    /// Encodes games into URIs, appending them to `out`, one per line.
+    void encode_all(span<const Game> games, QByteArray &out) {
+        for (const Game &game : games) {
+            encode(game, out);
+            out.append('\n');
+        }
+    }
+
+    /// Decodes URIs from text, one per line, skipping blank lines.
+    ///
+    /// For each line, calls `f(line, game, error)` with its 1-based
+    /// number, where `game` points to the decoded game, or is null if
+    /// decoding failed with `error`. The game is reused between calls.
+    template <usize N = BOARD_SIZE, class F>
+    void decode_all(span<const char> text, F &&f) {
+        BasicGame<N> game;
+        usize line = 0;
+        const char *p = text.data(), *end = p + text.size();
+        while (p != end) {
+            const char *eol = static_cast<const char *>(
+                std::memchr(p, '\n', end - p));
+            if (!eol)
+                eol = end;
+            line++;
+
+            span<const char> uri(p, eol);
+            bool blank = std::all_of(uri.begin(), uri.end(), is_space);
+            if (!blank) {
+                UriError error{};
+                bool ok = decode(uri, game, &error);
+                f(line, ok ? &game : nullptr, error);
+            }
+            p = eol == end ? end : eol + 1;
+        }
+    }
+};
+
+/// Encodes a game into a URI, in the form of `gomoku:<base64url>;`,
+/// with the whole tree of variations if `tree` is set.
+template <usize N>
+QByteArray encode_uri(const BasicGame<N> &game, bool tree = false) {
+    QByteArray uri;
+    UriCodec().encode(game, uri, tree);
+    return uri;
+}
+
+/// Decodes a URI into a game under the rule, ignoring surrounding
+/// whitespace.
+///
+/// On failure, the error is written to `error` if it is not null.
+template <usize N = BOARD_SIZE>
+optional<BasicGame<N>> decode_uri(const QByteArray &uri,
+                                  UriError *error = nullptr,
+                                  Rule rule = Rule::Freestyle) {
+    BasicGame<N> game(rule);
+    if (!UriCodec().decode({uri.constData(), usize(uri.size())}, game, error))
+        return nullopt;
+    return game;
+}